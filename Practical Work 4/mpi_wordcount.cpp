@@ -0,0 +1,143 @@
+#include <mpi.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include "../common/mpi_split.h"
+#include "wordcount.h"
+
+// MPI build of wordcount:
+//   mpicxx -std=c++17 -O2 mpi_wordcount.cpp -o mpi_wordcount
+//   mpirun -np 4 ./mpi_wordcount output.txt input1.txt input2.txt
+//
+// The inputs are treated as one byte stream split evenly across ranks. Each
+// rank maps and combines its share locally, then an all-to-all shuffle sends
+// every word to rank partition_of(hash(word), nranks). Rank r writes
+// <output_file>.part-<r>, the same files `wordcount --reducers nranks` gives.
+
+// Words cut by a range boundary belong to the rank they start in.
+static std::size_t map_range(const FileRange &range, CountTable &table) {
+    MappedFile mf(range.path);
+    if (!mf.ok()) {
+        std::cerr << "Error: cannot map input file: " << range.path << "\n";
+        return 0;
+    }
+    const char *data = mf.data();
+    auto [b, e] = align_range(data, mf.size(), range, is_word_byte);
+    if (b >= e) return 0;
+
+    std::string scratch;
+    return combine_range(data + b, data + e, table, scratch);
+}
+
+static CountTable shuffle(const CountTable &local, int nranks) {
+    std::vector<std::vector<char>> outgoing(nranks);
+    local.for_each([&](std::string_view key, std::uint64_t hash, int value) {
+        append_record(outgoing[partition_of(hash, nranks)], key, value);
+    });
+
+    std::vector<int> send_counts(nranks), recv_counts(nranks);
+    for (int r = 0; r < nranks; ++r) {
+        if (outgoing[r].size() > static_cast<std::size_t>(INT_MAX)) {
+            std::cerr << "Error: shuffle buffer for rank " << r
+                      << " exceeds 2 GB\n";
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        send_counts[r] = static_cast<int>(outgoing[r].size());
+    }
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT,
+                 recv_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+
+    std::vector<int> send_displs(nranks, 0), recv_displs(nranks, 0);
+    long long send_total = 0, recv_total = 0;
+    for (int r = 0; r < nranks; ++r) {
+        send_displs[r] = static_cast<int>(send_total);
+        recv_displs[r] = static_cast<int>(recv_total);
+        send_total += send_counts[r];
+        recv_total += recv_counts[r];
+    }
+    if (send_total > INT_MAX || recv_total > INT_MAX) {
+        std::cerr << "Error: shuffle volume per rank exceeds 2 GB\n";
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    std::vector<char> sendbuf(static_cast<std::size_t>(send_total));
+    for (int r = 0; r < nranks; ++r) {
+        if (!outgoing[r].empty()) {
+            std::memcpy(&sendbuf[send_displs[r]], outgoing[r].data(), outgoing[r].size());
+        }
+        std::vector<char>().swap(outgoing[r]);
+    }
+    std::vector<char> recvbuf(static_cast<std::size_t>(recv_total));
+    MPI_Alltoallv(sendbuf.data(), send_counts.data(), send_displs.data(), MPI_CHAR,
+                  recvbuf.data(), recv_counts.data(), recv_displs.data(), MPI_CHAR,
+                  MPI_COMM_WORLD);
+
+    CountTable partition;
+    const char *p = recvbuf.data(), *end = p + recvbuf.size();
+    std::string_view key;
+    int count;
+    while (decode_record(p, end, key, count)) partition.add(key, count);
+    return partition;
+}
+
+int main(int argc, char *argv[]) {
+    int rank, nranks;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+    if (argc < 3) {
+        if (rank == 0) {
+            std::cerr << "Usage: " << argv[0]
+                      << " <output_file> <input_file1> [input_file2 ...]\n"
+                      << "Example: mpirun -np 4 " << argv[0]
+                      << " output.txt input1.txt input2.txt\n";
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+    select_tokenizer("auto");
+
+    std::string output_file = argv[1];
+    std::vector<std::string> files(argv + 2, argv + argc);
+
+    std::vector<unsigned long long> sizes = broadcast_file_sizes(files, rank);
+
+    CountTable local;
+    unsigned long long mapped = 0;
+    for (const auto &range : assign_ranges(files, sizes, rank, nranks)) {
+        mapped += map_range(range, local);
+    }
+
+    CountTable partition = shuffle(local, nranks);
+    local = CountTable();
+
+    std::vector<KeyValue> result = partition.to_vector(true);
+    std::string part_file = part_file_name(output_file, static_cast<unsigned>(rank));
+    int ok = write_result(part_file, result) ? 1 : 0;
+
+    unsigned long long unique = result.size();
+    unsigned long long total_mapped = 0, total_unique = 0;
+    int all_ok = 0;
+    MPI_Reduce(&mapped, &total_mapped, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&unique, &total_unique, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        std::cout << "[MapReduce] Mapped " << total_mapped
+                  << " key-value pairs.\n";
+        std::cout << "[MapReduce] Reduced to " << total_unique
+                  << " unique words.\n";
+        std::cout << "[MapReduce] " << nranks << " partitions written to: "
+                  << part_file_name(output_file, 0) << " ... "
+                  << part_file_name(output_file, nranks - 1) << "\n";
+    }
+
+    MPI_Finalize();
+    return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,226 @@
+#ifndef TOKEN_FILTER_H
+#define TOKEN_FILTER_H
+
+// Optional stage between the tokenizer and the combiner: drops stopwords
+// and folds simple suffix variants before a word reaches a count table.
+//
+// The built-in English stopword list is a perfect hash set generated at
+// compile time (hash-and-displace, the same scheme as result_index.h), so a
+// lookup is one FNV-1a hash, two array reads and at most one compare. A
+// list loaded at run time goes into an InternTable instead. The normalizer
+// only ever shortens a word, so filtered words are still views into the
+// tokenizer's buffer.
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "wordcount.h"
+
+// Words as the tokenizer produces them: lowercase ASCII letters and digits,
+// so contractions show up as their pieces ("don", "t").
+inline constexpr std::string_view kBuiltinStopwords[] = {
+    "a", "about", "above", "after", "again", "against", "all", "am", "an", "and",
+    "any", "are", "as", "at", "be", "because", "been", "before", "being", "below",
+    "between", "both", "but", "by", "can", "did", "do", "does", "doing", "don",
+    "down", "during", "each", "few", "for", "from", "further", "had", "has", "have",
+    "having", "he", "her", "here", "hers", "herself", "him", "himself", "his", "how",
+    "i", "if", "in", "into", "is", "it", "its", "itself", "just", "me",
+    "more", "most", "my", "myself", "no", "nor", "not", "now", "of", "off",
+    "on", "once", "only", "or", "other", "our", "ours", "ourselves", "out", "over",
+    "own", "s", "same", "she", "should", "so", "some", "such", "t", "than",
+    "that", "the", "their", "theirs", "them", "themselves", "then", "there", "these", "they",
+    "this", "those", "through", "to", "too", "under", "until", "up", "very", "was",
+    "we", "were", "what", "when", "where", "which", "while", "who", "whom", "why",
+    "will", "with", "would", "you", "your", "yours", "yourself", "yourselves",
+};
+
+// Fixed set of N words with a collision-free slot per word. Built by
+// make_perfect_hash_set, normally as a constexpr variable.
+template <std::size_t N>
+struct PerfectHashSet {
+    static constexpr std::size_t kBuckets = N / 2 + 1;
+    static constexpr std::size_t kSlots = [] {
+        std::size_t s = 1;
+        while (s < 2 * N) s <<= 1;
+        return s;
+    }();
+
+    std::array<std::string_view, N> words{};
+    std::array<std::uint16_t, kBuckets> disp{};
+    std::array<std::uint16_t, kSlots> slots{};  // word index + 1, 0 = empty
+    std::size_t max_length = 0;
+    // leading[length][a] has bit b set if some word of that length starts
+    // with letters a, b (a, a for one-letter words); rejects most
+    // non-members before hashing.
+    std::array<std::array<std::uint32_t, 26>, 32> leading{};
+    bool ok = false;
+
+    static constexpr std::size_t bucket_of(std::uint64_t h) { return (h >> 32) % kBuckets; }
+
+    static constexpr std::size_t slot_of(std::uint64_t h, std::uint64_t d) {
+        std::uint64_t x = h ^ (d * 0x9E3779B97F4A7C15ULL);
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9ULL;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EBULL;
+        x ^= x >> 31;
+        return x & (kSlots - 1);
+    }
+
+    constexpr bool may_contain(std::string_view w) const {
+        unsigned a = static_cast<unsigned char>(w[0]) - 'a';
+        unsigned b = static_cast<unsigned char>(w[w.size() > 1]) - 'a';
+        return a < 26 && b < 26 && (leading[w.size()][a] >> b & 1);
+    }
+
+    constexpr bool contains(std::string_view w) const {
+        if (w.empty() || w.size() > max_length || !may_contain(w)) return false;
+        std::uint64_t h = fnv1a(w);
+        std::uint16_t id = slots[slot_of(h, disp[bucket_of(h)])];
+        return id != 0 && words[id - 1] == w;
+    }
+};
+
+// Places the largest buckets first and gives each bucket the first
+// displacement that puts all of its words on free, distinct slots. `ok` is
+// false if the list has duplicates (no displacement can separate them), or
+// words that are empty, 32 bytes or longer, or do not start with two
+// lowercase letters (one for single-letter words).
+template <std::size_t N>
+constexpr PerfectHashSet<N> make_perfect_hash_set(const std::string_view (&words)[N]) {
+    using Set = PerfectHashSet<N>;
+    Set set{};
+    std::array<std::uint64_t, N> hash{};
+    std::array<std::size_t, Set::kBuckets> size{};
+    for (std::size_t i = 0; i < N; ++i) {
+        set.words[i] = words[i];
+        if (words[i].size() > set.max_length) set.max_length = words[i].size();
+        if (words[i].empty() || words[i].size() >= set.leading.size()) return set;
+        unsigned a = static_cast<unsigned char>(words[i][0]) - 'a';
+        unsigned b = static_cast<unsigned char>(words[i][words[i].size() > 1]) - 'a';
+        if (a >= 26 || b >= 26) return set;
+        set.leading[words[i].size()][a] |= 1u << b;
+        hash[i] = fnv1a(words[i]);
+        ++size[Set::bucket_of(hash[i])];
+    }
+
+    std::array<std::size_t, Set::kBuckets> order{};
+    for (std::size_t b = 0; b < Set::kBuckets; ++b) order[b] = b;
+    for (std::size_t i = 1; i < Set::kBuckets; ++i) {
+        for (std::size_t j = i; j > 0 && size[order[j]] > size[order[j - 1]]; --j) {
+            std::size_t t = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = t;
+        }
+    }
+
+    for (std::size_t b : order) {
+        if (size[b] == 0) break;
+        bool placed = false;
+        for (std::uint64_t d = 0; d < 0xFFFF && !placed; ++d) {
+            std::array<std::size_t, N> taken{};
+            std::size_t count = 0;
+            placed = true;
+            for (std::size_t i = 0; i < N && placed; ++i) {
+                if (Set::bucket_of(hash[i]) != b) continue;
+                std::size_t s = Set::slot_of(hash[i], d);
+                if (set.slots[s] != 0) placed = false;
+                for (std::size_t k = 0; k < count && placed; ++k) {
+                    if (taken[k] == s) placed = false;
+                }
+                taken[count++] = s;
+            }
+            if (!placed) continue;
+            set.disp[b] = static_cast<std::uint16_t>(d);
+            count = 0;
+            for (std::size_t i = 0; i < N; ++i) {
+                if (Set::bucket_of(hash[i]) == b) {
+                    set.slots[taken[count++]] = static_cast<std::uint16_t>(i + 1);
+                }
+            }
+        }
+        if (!placed) return set;
+    }
+    set.ok = true;
+    return set;
+}
+
+inline constexpr auto kStopwords = make_perfect_hash_set(kBuiltinStopwords);
+static_assert(kStopwords.ok, "kBuiltinStopwords has a duplicate or unsupported word");
+static_assert(kStopwords.contains("the") && kStopwords.contains("yourselves") &&
+              !kStopwords.contains("mapreduce") && !kStopwords.contains(""));
+
+// Porter step 1a (sses -> ss, ies -> i, s -> "") and the suffix-dropping
+// half of step 1b (-ed, -ing after a stem with a vowel, then a doubled
+// final consonant is undone). Words of three bytes or less and words
+// ending in a digit are left alone.
+inline std::string_view strip_suffix(std::string_view w) {
+    if (w.size() <= 3 || w.back() < 'a') return w;
+    auto ends_with = [&](std::string_view s) {
+        return w.size() > s.size() && w.compare(w.size() - s.size(), s.size(), s) == 0;
+    };
+    auto is_vowel = [](char c) {
+        return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+    };
+
+    if (ends_with("sses") || ends_with("ies")) {
+        w.remove_suffix(2);
+    } else if (w.back() == 's' && w[w.size() - 2] != 's') {
+        w.remove_suffix(1);
+    }
+
+    if (ends_with("eed")) return w;
+    std::size_t suffix = ends_with("ing") ? 3 : ends_with("ed") ? 2 : 0;
+    if (suffix == 0) return w;
+    std::string_view stem = w.substr(0, w.size() - suffix);
+    bool vowel = false;
+    for (char c : stem) vowel = vowel || is_vowel(c);
+    if (!vowel || stem.size() < 2) return w;
+    char last = stem.back();
+    if (stem.size() >= 3 && last == stem[stem.size() - 2] && !is_vowel(last) &&
+        last != 'l' && last != 's' && last != 'z') {
+        stem.remove_suffix(1);
+    }
+    return stem;
+}
+
+class TokenFilter {
+public:
+    bool builtin_stopwords = false;
+    bool stem = false;
+
+    bool active() const { return builtin_stopwords || stem || extra_.size() > 0; }
+
+    // Adds the words of a text file (tokenized like the input) to the
+    // stopword list.
+    bool load_stopwords(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Error: cannot open stopword file: " << path << "\n";
+            return false;
+        }
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::string scratch;
+        tokenize(text.data(), text.data() + text.size(), scratch,
+                 [&](std::string_view w) { extra_.intern(w, hash_key(w)); });
+        return true;
+    }
+
+    // False if w is a stopword; otherwise w may be shortened in place.
+    bool apply(std::string_view &w) const {
+        if (builtin_stopwords && kStopwords.contains(w)) return false;
+        if (extra_.size() > 0 && extra_.find(w, hash_key(w)) != InternTable::kNone) return false;
+        if (stem) w = strip_suffix(w);
+        return true;
+    }
+
+private:
+    InternTable extra_;
+};
+
+#endif
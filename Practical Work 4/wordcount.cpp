@@ -3,59 +3,53 @@
 #include <vector>
 #include <string>
 #include <algorithm>
-#include <cctype>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <queue>
+#include <functional>
+#include <cstdlib>
+#include <mutex>
+#include <climits>
+#include <cerrno>
+#include <cmath>
+#include <deque>
+#include <poll.h>
+#include <unordered_map>
+#include <sys/stat.h>
 
-struct KeyValue {
-    std::string key;
-    int value;
-};
-
-std::string normalize_word(const std::string &w) {
-    std::string res;
-    res.reserve(w.size());
-    for (unsigned char c : w) {
-        if (std::isalnum(c)) {
-            res.push_back(std::tolower(c));
-        }
-    }
-    return res;
-}
+#include "wordcount.h"
+#include "token_filter.h"
+#include "../common/parse_size.h"
+#include "../common/result_index.h"
 
-std::vector<KeyValue> map_line(const std::string &line) {
-    std::vector<KeyValue> out;
-    std::string current;
-
-    for (unsigned char c : line) {
-        if (std::isalnum(c)) {
-            current.push_back(c);
-        } else {
-            if (!current.empty()) {
-                std::string w = normalize_word(current);
-                if (!w.empty()) {
-                    out.push_back({w, 1});
-                }
-                current.clear();
-            }
-        }
-    }
-    if (!current.empty()) {
-        std::string w = normalize_word(current);
-        if (!w.empty()) {
-            out.push_back({w, 1});
-        }
-    }
+// Stopword removal and normalization (--stopwords, --stopword-file, --stem),
+// configured once before any job runs.
+TokenFilter g_token_filter;
 
-    return out;
+// The map function: emit(word) for every word in [begin, end) that passes
+// g_token_filter. Returns the number of words emitted.
+template <typename Emit>
+std::size_t map_line(const char *begin, const char *end, std::string &scratch,
+                     Emit &&emit) {
+    if (!g_token_filter.active()) return tokenize(begin, end, scratch, emit);
+    std::size_t kept = 0;
+    tokenize(begin, end, scratch, [&](std::string_view w) {
+        if (!g_token_filter.apply(w)) return;
+        emit(w);
+        ++kept;
+    });
+    return kept;
 }
 
-std::vector<KeyValue> reduce_all(std::vector<KeyValue> &intermediate) {
+std::vector<KeyValue> reduce_all(std::vector<KeyValue> &intermediate,
+                                 unsigned sort_threads = 1) {
     std::vector<KeyValue> result;
     if (intermediate.empty()) return result;
 
-    std::sort(intermediate.begin(), intermediate.end(),
-              [](const KeyValue &a, const KeyValue &b) {
-                  return a.key < b.key;
-              });
+    parallel_sort(intermediate,
+                  [](const KeyValue &kv) { return std::string_view(kv.key); },
+                  sort_threads);
 
     std::string current_key = intermediate[0].key;
     int current_sum = 0;
@@ -74,53 +68,1729 @@ std::vector<KeyValue> reduce_all(std::vector<KeyValue> &intermediate) {
     return result;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0]
-                  << " <output_file> <input_file1> [input_file2 ...]\n";
-        return 1;
+// ---- External-memory spill ----
+//
+// With --memory-budget, a combiner table that outgrows its share of the
+// budget is written out as sorted runs, one per reduce partition, and then
+// cleared. The reduce phase streams a k-way merge over the runs, which are
+// files of count records (see wordcount.h).
+
+const std::size_t kStreamBuffer = 1 << 20;
+// Under a memory budget, tables are checked after every chunk of input of
+// at most this size, which bounds how far a table can overshoot.
+const std::size_t kSpillChunk = 4 << 20;
+
+class Spiller {
+public:
+    Spiller(const std::string &dir, unsigned partitions)
+        : dir_(dir), runs_(partitions) {}
+
+    ~Spiller() {
+        for (const auto &part : runs_) {
+            for (const auto &path : part) std::remove(path.c_str());
+        }
+    }
+
+    Spiller(const Spiller &) = delete;
+    Spiller &operator=(const Spiller &) = delete;
+
+    // Safe to call from several map workers at once.
+    bool spill(CountTable &table) {
+        if (table.size() == 0) return true;
+        const unsigned partitions = static_cast<unsigned>(runs_.size());
+        std::vector<FILE *> files(partitions, nullptr);
+        std::vector<std::string> paths(partitions);
+        bool ok = true;
+
+        for (const auto &e : table.entries(true)) {
+            unsigned p = partition_of(e.hash, partitions);
+            if (!files[p] && !(files[p] = create_run(paths[p]))) {
+                ok = false;
+                break;
+            }
+            write_record(files[p], e.key, e.value);
+        }
+        for (auto *fp : files) {
+            if (fp && std::fclose(fp) != 0) ok = false;
+        }
+        table.clear();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (unsigned p = 0; p < partitions; ++p) {
+            if (!paths[p].empty()) runs_[p].push_back(paths[p]);
+        }
+        ++spills_;
+        if (!ok) {
+            failed_ = true;
+            std::cerr << "Error: cannot write spill run in " << dir_ << "\n";
+        }
+        return ok;
+    }
+
+    std::size_t spills() const { return spills_; }
+    // A failed spill has already dropped its table, so the job cannot finish.
+    bool failed() const { return failed_; }
+    std::vector<std::string> &runs(unsigned p) { return runs_[p]; }
+    const std::vector<std::string> &runs(unsigned p) const { return runs_[p]; }
+
+    FILE *create_run(std::string &path) {
+        std::string tmpl = dir_ + "/wordcount-run-XXXXXX";
+        int fd = ::mkstemp(&tmpl[0]);
+        if (fd < 0) return nullptr;
+        FILE *fp = ::fdopen(fd, "wb");
+        if (!fp) {
+            ::close(fd);
+            std::remove(tmpl.c_str());
+            return nullptr;
+        }
+        std::setvbuf(fp, nullptr, _IOFBF, kStreamBuffer);
+        path = tmpl;
+        return fp;
+    }
+
+private:
+    std::string dir_;
+    std::vector<std::vector<std::string>> runs_;
+    std::size_t spills_ = 0;
+    bool failed_ = false;
+    std::mutex mutex_;
+};
+
+inline void maybe_spill(CountTable &table, std::size_t limit, Spiller *spiller) {
+    if (spiller && table.memory_bytes() > limit) spiller->spill(table);
+}
+
+class RunReader {
+public:
+    explicit RunReader(const std::string &path) : fp_(std::fopen(path.c_str(), "rb")) {
+        if (fp_) std::setvbuf(fp_, nullptr, _IOFBF, kStreamBuffer);
+    }
+    ~RunReader() {
+        if (fp_) std::fclose(fp_);
+    }
+    RunReader(const RunReader &) = delete;
+    RunReader &operator=(const RunReader &) = delete;
+
+    bool ok() const { return fp_ != nullptr; }
+
+    bool next(std::string &key, long long &value) {
+        int count;
+        if (!read_record(fp_, key, count)) return false;
+        value = count;
+        return true;
+    }
+
+private:
+    FILE *fp_;
+};
+
+// Reads "word count" lines as written by write_result. The file is read
+// with read(2) into one buffer (grown only for a line longer than it) and
+// split with memchr.
+class ResultFileReader {
+public:
+    explicit ResultFileReader(const std::string &path)
+        : buf_(kStreamBuffer), fd_(::open(path.c_str(), O_RDONLY)) {}
+    ~ResultFileReader() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+    ResultFileReader(const ResultFileReader &) = delete;
+    ResultFileReader &operator=(const ResultFileReader &) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+
+    bool next(std::string &key, long long &value) {
+        for (;;) {
+            const char *begin = buf_.data() + pos_;
+            const char *end = buf_.data() + end_;
+            const char *nl = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+            if (!nl && !eof_) {
+                refill();
+                continue;
+            }
+            if (!nl && begin == end) return false;
+            const char *line_end = nl ? nl : end;  // last line may lack '\n'
+            pos_ = static_cast<std::size_t>(line_end - buf_.data()) + (nl ? 1 : 0);
+
+            std::string_view line(begin, static_cast<std::size_t>(line_end - begin));
+            std::size_t sp = line.rfind(' ');
+            if (sp == std::string_view::npos) continue;
+            key.assign(begin, sp);
+            value = std::strtoll(begin + sp + 1, nullptr, 10);
+            return true;
+        }
+    }
+
+private:
+    void refill() {
+        std::size_t left = end_ - pos_;
+        std::memmove(buf_.data(), buf_.data() + pos_, left);
+        pos_ = 0;
+        end_ = left;
+        if (end_ == buf_.size()) buf_.resize(buf_.size() * 2);
+        for (;;) {
+            ssize_t n = ::read(fd_, buf_.data() + end_, buf_.size() - end_);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                eof_ = true;
+            } else {
+                end_ += static_cast<std::size_t>(n);
+            }
+            return;
+        }
+    }
+
+    std::vector<char> buf_;
+    int fd_;
+    std::size_t pos_ = 0, end_ = 0;
+    bool eof_ = false;
+};
+
+// First 8 key bytes as a big-endian integer (zero padded): comparing two
+// prefixes orders the keys unless they are equal.
+inline std::uint64_t key_prefix(std::string_view key) {
+    std::uint64_t p = 0;
+    std::size_t n = std::min<std::size_t>(key.size(), 8);
+    for (std::size_t i = 0; i < n; ++i) {
+        p |= static_cast<std::uint64_t>(static_cast<unsigned char>(key[i])) << (56 - 8 * i);
+    }
+    return p;
+}
+
+// Streams a k-way heap merge over sorted sources and calls emit(key, sum)
+// once per distinct key, in key order. Memory is one record per source.
+// The heap holds source indices and compares cached key prefixes first, so
+// a step moves a few integers and rarely touches the strings.
+// Returns the number of distinct keys.
+template <typename Source, typename Emit>
+std::size_t kway_merge(std::vector<std::unique_ptr<Source>> &sources, Emit &&emit) {
+    struct Head {
+        std::string key;
+        long long value = 0;
+        std::uint64_t prefix = 0;
+    };
+    std::vector<Head> heads(sources.size());
+    auto load = [&](std::size_t i) {
+        Head &h = heads[i];
+        if (!sources[i]->next(h.key, h.value)) return false;
+        h.prefix = key_prefix(h.key);
+        return true;
+    };
+    auto greater = [&](std::size_t a, std::size_t b) {
+        const Head &x = heads[a], &y = heads[b];
+        return x.prefix != y.prefix ? x.prefix > y.prefix : x.key > y.key;
+    };
+
+    std::vector<std::size_t> heap;
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        if (load(i)) heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), greater);
+
+    // Restores the heap after the top source advanced.
+    auto sift_down = [&]() {
+        const std::size_t n = heap.size();
+        std::size_t i = 0, top = heap[0];
+        for (;;) {
+            std::size_t c = 2 * i + 1;
+            if (c >= n) break;
+            if (c + 1 < n && greater(heap[c], heap[c + 1])) ++c;
+            if (!greater(top, heap[c])) break;
+            heap[i] = heap[c];
+            i = c;
+        }
+        heap[i] = top;
+    };
+
+    std::string current;
+    long long sum = 0;
+    std::size_t unique = 0;
+    while (!heap.empty()) {
+        Head &h = heads[heap[0]];
+        if (unique > 0 && h.key == current) {
+            sum += h.value;
+        } else {
+            if (unique > 0) emit(current, sum);
+            current.swap(h.key);
+            sum = h.value;
+            ++unique;
+        }
+        if (!load(heap[0])) {
+            heap[0] = heap.back();
+            heap.pop_back();
+        }
+        if (!heap.empty()) sift_down();
+    }
+    if (unique > 0) emit(current, sum);
+    return unique;
+}
+
+// Keeps the number of files open in one merge bounded: while a partition
+// has more than kMaxFanIn runs, groups of them are merged into a new run.
+const std::size_t kMaxFanIn = 128;
+
+bool compact_runs(Spiller &spiller, unsigned p) {
+    std::vector<std::string> &runs = spiller.runs(p);
+    while (runs.size() > kMaxFanIn) {
+        std::vector<std::string> group(runs.begin(), runs.begin() + kMaxFanIn);
+        std::vector<std::unique_ptr<RunReader>> sources;
+        for (const auto &path : group) {
+            sources.push_back(std::make_unique<RunReader>(path));
+            if (!sources.back()->ok()) return false;
+        }
+        std::string merged;
+        FILE *fp = spiller.create_run(merged);
+        if (!fp) return false;
+        kway_merge(sources, [&](const std::string &key, long long value) {
+            write_record(fp, key, static_cast<int>(value));
+        });
+        bool ok = std::fclose(fp) == 0;
+        sources.clear();
+        for (const auto &path : group) std::remove(path.c_str());
+        runs.erase(runs.begin(), runs.begin() + kMaxFanIn);
+        runs.push_back(merged);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+template <typename Source>
+bool merge_files_to(const std::vector<std::string> &paths,
+                    const std::string &output_path, std::size_t &unique,
+                    ResultFormat format) {
+    std::vector<std::unique_ptr<Source>> sources;
+    for (const auto &path : paths) {
+        auto src = std::make_unique<Source>(path);
+        if (!src->ok()) {
+            std::cerr << "Error: cannot open run file: " << path << "\n";
+            return false;
+        }
+        sources.push_back(std::move(src));
+    }
+
+    ResultWriter out(format);
+    if (!out.open(output_path)) return false;
+    unique = kway_merge(sources, [&](const std::string &key, long long value) {
+        out.record(key, value);
+    });
+    return out.close();
+}
+
+// ---- Shuffle / reduce ----
+
+// Reducer r pulls the entries of its partition out of every map output,
+// so the shuffle needs no intermediate copy of the map tables.
+std::vector<KeyValue> reduce_table_partition(
+        const std::vector<CountTable> &map_outputs,
+        unsigned r, unsigned partitions, bool sorted, unsigned sort_threads) {
+    if (partitions == 1 && map_outputs.size() == 1) {
+        return map_outputs[0].to_vector(sorted, sort_threads);
+    }
+    CountTable part;
+    for (const auto &table : map_outputs) {
+        table.for_each([&](std::string_view key, std::uint64_t hash, int value) {
+            if (partition_of(hash, partitions) == r) part.add(key, hash, value);
+        });
+    }
+    return part.to_vector(sorted, sort_threads);
+}
+
+// K-way merge of sorted partitions into one sorted file. Partitions hold
+// disjoint keys, so this is a plain heap merge with no summing.
+bool write_merged(const std::string &path,
+                  const std::vector<std::vector<KeyValue>> &parts,
+                  ResultFormat format) {
+    ResultWriter out(format);
+    if (!out.open(path)) return false;
+
+    using Cursor = std::pair<std::size_t, std::size_t>;  // partition, index
+    auto greater = [&](const Cursor &a, const Cursor &b) {
+        return parts[a.first][a.second].key > parts[b.first][b.second].key;
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(greater)> heap(greater);
+    for (std::size_t p = 0; p < parts.size(); ++p) {
+        if (!parts[p].empty()) heap.push({p, 0});
+    }
+    while (!heap.empty()) {
+        Cursor c = heap.top();
+        heap.pop();
+        const KeyValue &kv = parts[c.first][c.second];
+        out.record(kv.key, kv.value);
+        if (++c.second < parts[c.first].size()) heap.push(c);
+    }
+    return out.close();
+}
+
+// ---- Job definitions for the MapReduce engine ----
+
+// Chunks may only be cut between words.
+struct WordBoundary {
+    std::size_t align(const char *data, std::size_t size, std::size_t pos) const {
+        while (pos < size && is_word_byte(data[pos])) ++pos;
+        return pos;
+    }
+};
+
+// Combiner mode (--hash and everything built on it): each worker folds its
+// words into its own CountTable.
+struct TableMapper : WordBoundary {
+    std::string scratch;
+
+    std::size_t map(const char *begin, const char *end, CountTable &out) {
+        return map_line(begin, end, scratch, [&](std::string_view w) { out.add(w); });
+    }
+};
+
+struct TableReducer {
+    using Result = std::vector<KeyValue>;
+    bool sorted = true;
+    unsigned sort_threads = 1;
+
+    Result reduce(std::vector<CountTable> &outputs, unsigned r, unsigned partitions) const {
+        return reduce_table_partition(outputs, r, partitions, sorted, sort_threads);
+    }
+};
+
+// Original sort-based mode: one KeyValue per token. Pairs are bucketed by
+// partition as they are emitted, so reducer r only touches bucket r.
+using PairBuckets = std::vector<std::vector<KeyValue>>;
+
+struct PairMapper : WordBoundary {
+    unsigned partitions = 1;
+    std::string scratch;
+
+    std::size_t map(const char *begin, const char *end, PairBuckets &out) {
+        if (out.empty()) out.resize(partitions);
+        return map_line(begin, end, scratch, [&](std::string_view w) {
+            unsigned p = partitions == 1 ? 0 : partition_of(hash_key(w), partitions);
+            out[p].push_back({std::string(w), 1});
+        });
+    }
+};
+
+struct PairReducer {
+    using Result = std::vector<KeyValue>;
+    unsigned sort_threads = 1;
+
+    Result reduce(std::vector<PairBuckets> &outputs, unsigned r, unsigned) const {
+        std::vector<KeyValue> intermediate;
+        for (auto &buckets : outputs) {
+            if (r >= buckets.size()) continue;
+            if (intermediate.empty()) {
+                intermediate.swap(buckets[r]);
+            } else {
+                intermediate.insert(intermediate.end(),
+                                    std::make_move_iterator(buckets[r].begin()),
+                                    std::make_move_iterator(buckets[r].end()));
+                std::vector<KeyValue>().swap(buckets[r]);
+            }
+        }
+        return reduce_all(intermediate, sort_threads);
+    }
+};
+
+// ---- Top-K (heavy hitters) ----
+//
+// --top K answers "most frequent words" in fixed memory. A Count-Min sketch
+// estimates every word's count, and a bounded min-heap keeps the words with
+// the highest estimates seen so far. Estimates never undercount; --exact
+// re-reads the inputs and counts only the surviving candidates.
+
+class CountMinSketch {
+public:
+    static constexpr unsigned kDepth = 4;
+
+    explicit CountMinSketch(std::size_t width) {
+        width_ = 1;
+        while (width_ < width) width_ <<= 1;
+        counters_.assign(width_ * kDepth, 0);
+    }
+
+    // Conservative update: only the counters still at the minimum are raised,
+    // which overestimates noticeably less than bumping all rows.
+    std::uint32_t add(std::uint64_t hash) {
+        std::size_t idx[kDepth];
+        std::uint32_t est = UINT32_MAX;
+        slots(hash, idx);
+        for (unsigned r = 0; r < kDepth; ++r) est = std::min(est, counters_[idx[r]]);
+        if (est != UINT32_MAX) ++est;
+        for (unsigned r = 0; r < kDepth; ++r) {
+            if (counters_[idx[r]] < est) counters_[idx[r]] = est;
+        }
+        return est;
+    }
+
+private:
+    // Row r uses h1 + r * h2 (double hashing) over its own stripe.
+    void slots(std::uint64_t hash, std::size_t *idx) const {
+        std::uint64_t h1 = hash;
+        std::uint64_t h2 = ((hash * 0x9E3779B97F4A7C15ULL) >> 32) | 1;
+        for (unsigned r = 0; r < kDepth; ++r) {
+            idx[r] = r * width_ + ((h1 + r * h2) & (width_ - 1));
+        }
+    }
+
+    std::size_t width_;
+    std::vector<std::uint32_t> counters_;
+};
+
+// Fixed-capacity candidate set: a min-heap by count plus an open-addressing
+// index for membership. When full, a newcomer only gets in by beating the
+// current minimum, which it then replaces.
+class TopKCandidates {
+public:
+    explicit TopKCandidates(std::size_t capacity) : capacity_(capacity) {
+        std::size_t cap = 16;
+        while (cap < capacity * 4) cap <<= 1;
+        index_.assign(cap, kEmpty);
+        items_.reserve(capacity);
+        heap_.reserve(capacity);
+    }
+
+    void offer(std::string_view key, std::uint64_t hash, std::uint64_t estimate) {
+        std::int32_t i = find(key, hash);
+        if (i >= 0) {
+            items_[i].count = estimate;
+            sift_down(items_[i].heap_pos);
+            return;
+        }
+        if (items_.size() < capacity_) {
+            i = static_cast<std::int32_t>(items_.size());
+            items_.push_back({std::string(key), hash, estimate, heap_.size()});
+            heap_.push_back(static_cast<std::uint32_t>(i));
+            insert_index(i);
+            sift_up(heap_.size() - 1);
+            return;
+        }
+        i = static_cast<std::int32_t>(heap_[0]);
+        if (estimate <= items_[i].count) return;
+        erase_index(i);
+        items_[i].key.assign(key.data(), key.size());
+        items_[i].hash = hash;
+        items_[i].count = estimate;
+        insert_index(i);
+        sift_down(0);
+    }
+
+    std::int32_t find(std::string_view key, std::uint64_t hash) const {
+        std::size_t mask = index_.size() - 1;
+        for (std::size_t p = hash & mask;; p = (p + 1) & mask) {
+            std::int32_t i = index_[p];
+            if (i == kEmpty) return -1;
+            if (i >= 0 && items_[i].hash == hash && items_[i].key == key) return i;
+        }
+    }
+
+    void reset_counts() {
+        for (auto &item : items_) item.count = 0;
+    }
+    void bump(std::int32_t i) { ++items_[i].count; }
+
+    // Top k candidates by count (descending), ties by word.
+    std::vector<KeyValue> top(std::size_t k) const {
+        std::vector<const Item *> order;
+        for (const auto &item : items_) order.push_back(&item);
+        std::sort(order.begin(), order.end(), [](const Item *a, const Item *b) {
+            if (a->count != b->count) return a->count > b->count;
+            return a->key < b->key;
+        });
+        std::vector<KeyValue> out;
+        for (std::size_t j = 0; j < order.size() && j < k; ++j) {
+            if (order[j]->count == 0) break;
+            out.push_back({order[j]->key, static_cast<int>(order[j]->count)});
+        }
+        return out;
+    }
+
+private:
+    static constexpr std::int32_t kEmpty = -1;
+    static constexpr std::int32_t kDeleted = -2;
+
+    struct Item {
+        std::string key;
+        std::uint64_t hash;
+        std::uint64_t count;
+        std::size_t heap_pos;
+    };
+
+    void insert_index(std::int32_t i) {
+        std::size_t mask = index_.size() - 1;
+        std::size_t p = items_[i].hash & mask;
+        while (index_[p] >= 0) p = (p + 1) & mask;
+        if (index_[p] == kDeleted) --deleted_;
+        index_[p] = i;
+    }
+
+    void erase_index(std::int32_t i) {
+        std::size_t mask = index_.size() - 1;
+        std::size_t p = items_[i].hash & mask;
+        while (index_[p] != i) p = (p + 1) & mask;
+        index_[p] = kDeleted;
+        if (++deleted_ > capacity_) rebuild_index();
+    }
+
+    void rebuild_index() {
+        index_.assign(index_.size(), kEmpty);
+        deleted_ = 0;
+        for (std::size_t i = 0; i < items_.size(); ++i) {
+            insert_index(static_cast<std::int32_t>(i));
+        }
+    }
+
+    bool less(std::size_t a, std::size_t b) const {
+        return items_[heap_[a]].count < items_[heap_[b]].count;
+    }
+
+    void swap_nodes(std::size_t a, std::size_t b) {
+        std::swap(heap_[a], heap_[b]);
+        items_[heap_[a]].heap_pos = a;
+        items_[heap_[b]].heap_pos = b;
+    }
+
+    void sift_up(std::size_t pos) {
+        while (pos > 0 && less(pos, (pos - 1) / 2)) {
+            swap_nodes(pos, (pos - 1) / 2);
+            pos = (pos - 1) / 2;
+        }
+    }
+
+    void sift_down(std::size_t pos) {
+        while (true) {
+            std::size_t l = 2 * pos + 1, r = l + 1, m = pos;
+            if (l < heap_.size() && less(l, m)) m = l;
+            if (r < heap_.size() && less(r, m)) m = r;
+            if (m == pos) return;
+            swap_nodes(pos, m);
+            pos = m;
+        }
+    }
+
+    std::size_t capacity_;
+    std::vector<Item> items_;
+    std::vector<std::uint32_t> heap_;
+    std::vector<std::int32_t> index_;
+    std::size_t deleted_ = 0;
+};
+
+int run_top_k(std::size_t k, bool exact, std::size_t sketch_width,
+              const std::vector<std::string> &input_files,
+              const std::string &output_file, ResultFormat format) {
+    // Some slack over k so words near the cut-off are less likely to be
+    // evicted by estimation noise.
+    TopKCandidates candidates(std::max<std::size_t>(2 * k, k + 64));
+    CountMinSketch sketch(sketch_width);
+
+    std::string scratch;
+    std::size_t mapped = 0;
+    scan_files(input_files, [&](const char *b, const char *e) {
+        mapped += map_line(b, e, scratch, [&](std::string_view w) {
+            std::uint64_t h = hash_key(w);
+            candidates.offer(w, h, sketch.add(h));
+        });
+    });
+    std::cout << "[MapReduce] Mapped " << mapped
+              << " key-value pairs.\n";
+
+    if (exact) {
+        candidates.reset_counts();
+        scan_files(input_files, [&](const char *b, const char *e) {
+            map_line(b, e, scratch, [&](std::string_view w) {
+                std::int32_t i = candidates.find(w, hash_key(w));
+                if (i >= 0) candidates.bump(i);
+            });
+        });
+    }
+
+    std::vector<KeyValue> result = candidates.top(k);
+    std::cout << "[MapReduce] Top " << result.size() << " words ("
+              << (exact ? "exact" : "estimated") << " counts).\n";
+    if (!write_result(output_file, result, format)) return 1;
+    std::cout << "[MapReduce] Result written to: " << output_file << "\n";
+    return 0;
+}
+
+struct Options {
+    bool hash_combine = false;
+    bool use_mmap = false;
+    bool pipeline = false;
+    bool use_io_uring = true;
+    unsigned io_buffers = 0;  // 0: the job's default
+    unsigned num_threads = 1;
+    unsigned num_reducers = 1;
+    unsigned sort_threads = 0;  // 0: --threads spread over the reducers
+    bool merge_parts = false;
+    bool merge_results = false;
+    std::size_t memory_budget = 0;
+    std::string spill_dir;
+    std::string cache_dir;
+    bool stream = false;
+    double window_seconds = 60;
+    double slide_seconds = 0;  // 0: same as the window (tumbling)
+    std::size_t top_k = 0;
+    bool top_exact = false;
+    std::size_t sketch_width = 1 << 20;
+    std::string tokenizer = "auto";
+    bool stopwords = false;
+    std::string stopword_file;
+    bool stem = false;
+    bool sorted_output = true;
+    ResultFormat format = ResultFormat::Text;
+    bool show_stats = false;
+    std::string stats_json;
+    std::string index_file;
+    std::string output_file;
+    std::vector<std::string> input_files;
+};
+
+// Where spill runs and intermediate merges go: --spill-dir, else $TMPDIR,
+// else /tmp.
+std::string default_spill_dir(const Options &opt) {
+    if (!opt.spill_dir.empty()) return opt.spill_dir;
+    const char *tmp = std::getenv("TMPDIR");
+    return tmp && *tmp ? tmp : "/tmp";
+}
+
+void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog
+              << " [options] <output_file> <input_file1> [input_file2 ...]\n"
+              << "Options:\n"
+              << "  --hash         combine counts in a hash table while mapping\n"
+              << "  --unsorted     with --hash, write words in table order\n"
+              << "  --binary       write records as varint key length, key bytes, varint count\n"
+              << "  --index F      also write a memory-mappable lookup index of the result\n"
+              << "                 to F (see wordcount_query)\n"
+              << "  --mmap         memory-map inputs and tokenize in place (implies --hash)\n"
+              << "  --threads N    map with N worker threads (implies --mmap)\n"
+              << "  --pipeline     read inputs on a separate I/O thread into a fixed pool of\n"
+              << "                 buffers that the map threads consume (implies --hash)\n"
+              << "  --io-buffers N with --pipeline, number of 4 MB buffers (default 2 per\n"
+              << "                 thread + 2)\n"
+              << "  --pread        with --pipeline, read with pread instead of io_uring\n"
+              << "  --tokenizer K  auto | avx2 | sse4.2 | scalar (default auto)\n"
+              << "  --stopwords    drop common English words before counting them\n"
+              << "  --stopword-file F\n"
+              << "                 drop the words listed in F (any separators)\n"
+              << "  --stem         fold plural, -ed and -ing forms onto one stem\n"
+              << "  --stats        print per-phase timings and throughput\n"
+              << "  --stats-json F write the per-phase timings to F as JSON\n"
+              << "  --reducers R   hash-partition into R reducers, written to\n"
+              << "                 <output_file>.part-00000 ... in parallel\n"
+              << "  --sort-threads N\n"
+              << "                 threads for the reduce-side sort (default: --threads\n"
+              << "                 divided among the reducers)\n"
+              << "  --merge        with --reducers, also merge the parts into <output_file>\n"
+              << "  --merge-results\n"
+              << "                 the inputs are sorted result files of earlier runs (in\n"
+              << "                 the --binary format if given); merge them summing counts\n"
+              << "  --memory-budget SIZE\n"
+              << "                 spill sorted runs to disk when the count tables grow\n"
+              << "                 past SIZE bytes (K/M/G suffixes, implies --hash)\n"
+              << "  --spill-dir D  directory for spill runs (default $TMPDIR or /tmp)\n"
+              << "  --cache DIR    incremental mode: keep per-file counts in DIR and only\n"
+              << "                 re-map inputs that changed since the last run (implies --hash)\n"
+              << "  --stream       read stdin until EOF and write the top words of a moving\n"
+              << "                 time window after every slide; <output_file> is\n"
+              << "                 rewritten each time (\"-\" for stdout), no input files\n"
+              << "  --window S     with --stream, window length in seconds (default 60)\n"
+              << "  --slide S      with --stream, slide interval in seconds (default: the\n"
+              << "                 window, i.e. tumbling windows)\n"
+              << "  --top K        only write the K most frequent words, tracked in fixed\n"
+              << "                 memory with a Count-Min sketch (counts are estimates)\n"
+              << "  --exact        with --top, re-read the inputs to count candidates exactly\n"
+              << "  --sketch-width W\n"
+              << "                 counters per sketch row (default 1048576, 4 rows)\n";
+}
+
+// Returns the argument following option argv[i] and advances i, or nullptr
+// if the option is the last argument.
+const char *option_value(int argc, char *argv[], int &i) {
+    if (i + 1 >= argc) {
+        std::cerr << "Error: " << argv[i] << " needs a value\n";
+        return nullptr;
+    }
+    return argv[++i];
+}
+
+bool option_count(int argc, char *argv[], int &i, unsigned long &out) {
+    const char *name = argv[i];
+    const char *value = option_value(argc, argv, i);
+    if (!value) return false;
+    char *end = nullptr;
+    out = std::strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || out == 0) {
+        std::cerr << "Error: invalid value for " << name << ": " << value << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool parse_args(int argc, char *argv[], Options &opt) {
+    int i = 1;
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) break;
+        unsigned long n = 0;
+        const char *value = nullptr;
+        if (arg == "--hash") {
+            opt.hash_combine = true;
+        } else if (arg == "--mmap") {
+            opt.use_mmap = true;
+            opt.hash_combine = true;
+        } else if (arg == "--threads") {
+            if (!option_count(argc, argv, i, n)) return false;
+            opt.num_threads = static_cast<unsigned>(n);
+            opt.use_mmap = true;
+            opt.hash_combine = true;
+        } else if (arg == "--pipeline") {
+            opt.pipeline = true;
+            opt.hash_combine = true;
+        } else if (arg == "--io-buffers") {
+            if (!option_count(argc, argv, i, n)) return false;
+            opt.io_buffers = static_cast<unsigned>(n);
+        } else if (arg == "--pread") {
+            opt.use_io_uring = false;
+        } else if (arg == "--reducers") {
+            if (!option_count(argc, argv, i, n)) return false;
+            opt.num_reducers = static_cast<unsigned>(n);
+        } else if (arg == "--sort-threads") {
+            if (!option_count(argc, argv, i, n)) return false;
+            opt.sort_threads = static_cast<unsigned>(n);
+        } else if (arg == "--merge") {
+            opt.merge_parts = true;
+        } else if (arg == "--merge-results") {
+            opt.merge_results = true;
+        } else if (arg == "--memory-budget") {
+            if (!(value = option_value(argc, argv, i))) return false;
+            opt.memory_budget = parse_size(value);
+            if (opt.memory_budget == 0) {
+                std::cerr << "Error: invalid memory budget: " << value << "\n";
+                return false;
+            }
+            opt.hash_combine = true;
+        } else if (arg == "--spill-dir") {
+            if (!(value = option_value(argc, argv, i))) return false;
+            opt.spill_dir = value;
+        } else if (arg == "--cache") {
+            if (!(value = option_value(argc, argv, i))) return false;
+            opt.cache_dir = value;
+            opt.hash_combine = true;
+        } else if (arg == "--stream") {
+            opt.stream = true;
+        } else if (arg == "--window" || arg == "--slide") {
+            if (!(value = option_value(argc, argv, i))) return false;
+            char *end = nullptr;
+            double secs = std::strtod(value, &end);
+            if (end == value || *end != '\0' || secs <= 0) {
+                std::cerr << "Error: invalid value for " << arg << ": " << value << "\n";
+                return false;
+            }
+            (arg == "--window" ? opt.window_seconds : opt.slide_seconds) = secs;
+        } else if (arg == "--top") {
+            if (!option_count(argc, argv, i, n)) return false;
+            opt.top_k = n;
+        } else if (arg == "--exact") {
+            opt.top_exact = true;
+        } else if (arg == "--sketch-width") {
+            if (!option_count(argc, argv, i, n)) return false;
+            opt.sketch_width = n;
+        } else if (arg == "--tokenizer") {
+            if (!(value = option_value(argc, argv, i))) return false;
+            opt.tokenizer = value;
+        } else if (arg == "--stopwords") {
+            opt.stopwords = true;
+        } else if (arg == "--stopword-file") {
+            if (!(value = option_value(argc, argv, i))) return false;
+            opt.stopword_file = value;
+        } else if (arg == "--stem") {
+            opt.stem = true;
+        } else if (arg == "--stats") {
+            opt.show_stats = true;
+        } else if (arg == "--stats-json") {
+            if (!(value = option_value(argc, argv, i))) return false;
+            opt.stats_json = value;
+        } else if (arg == "--index") {
+            if (!(value = option_value(argc, argv, i))) return false;
+            opt.index_file = value;
+        } else if (arg == "--binary") {
+            opt.format = ResultFormat::Binary;
+        } else if (arg == "--unsorted") {
+            opt.sorted_output = false;
+        } else {
+            std::cerr << "Error: unknown option: " << arg << "\n";
+            return false;
+        }
+    }
+    if (argc - i < (opt.stream ? 1 : 2)) return false;
+    if (opt.stream && (argc - i > 1 || !opt.cache_dir.empty() || !opt.index_file.empty() ||
+                       opt.memory_budget > 0 || opt.top_exact)) {
+        std::cerr << "Error: --stream reads stdin only and takes no files, --cache,"
+                     " --index, --memory-budget or --exact\n";
+        return false;
+    }
+    if (opt.pipeline && (opt.stream || opt.top_k > 0)) {
+        std::cerr << "Error: --pipeline cannot be combined with --stream or --top\n";
+        return false;
+    }
+    // --top scans the inputs once (twice with --exact) on one thread into a
+    // fixed-size sketch, so none of the job options would apply.
+    if (opt.top_k > 0 && !opt.stream &&
+        (opt.use_mmap || opt.num_reducers > 1 || opt.memory_budget > 0)) {
+        std::cerr << "Error: --top cannot be combined with --mmap, --threads, --reducers"
+                     " or --memory-budget\n";
+        return false;
+    }
+    if (opt.merge_results && (opt.stream || opt.top_k > 0 || !opt.cache_dir.empty() ||
+                              opt.num_reducers > 1 || !opt.sorted_output)) {
+        std::cerr << "Error: --merge-results cannot be combined with --stream, --top,"
+                     " --cache, --reducers or --unsorted\n";
+        return false;
+    }
+    if (opt.slide_seconds > opt.window_seconds) {
+        std::cerr << "Error: --slide cannot be longer than --window\n";
+        return false;
+    }
+    if (!opt.index_file.empty() && (!opt.sorted_output || opt.top_k > 0)) {
+        std::cerr << "Error: --index needs sorted output (not --unsorted or --top)\n";
+        return false;
+    }
+    if (opt.sort_threads == 0) {
+        opt.sort_threads = std::max(1u, opt.num_threads / opt.num_reducers);
+    }
+    if (!opt.cache_dir.empty() && (opt.memory_budget > 0 || opt.top_k > 0)) {
+        std::cerr << "Error: --cache cannot be combined with --memory-budget or --top\n";
+        return false;
+    }
+    // Cached per-file counts do not record which filter produced them.
+    if (!opt.cache_dir.empty() && (opt.stopwords || opt.stem || !opt.stopword_file.empty())) {
+        std::cerr << "Error: --cache cannot be combined with --stopwords, --stopword-file"
+                     " or --stem\n";
+        return false;
+    }
+
+    opt.output_file = argv[i++];
+    for (; i < argc; ++i) {
+        opt.input_files.push_back(argv[i]);
+    }
+    return true;
+}
+
+// Reduce phase once anything has been spilled: each partition is a k-way
+// merge over its runs, streamed straight into its output file.
+bool reduce_spilled(Spiller &spiller, unsigned partitions, const std::string &output_file,
+                    ResultFormat format, std::size_t &unique) {
+    if (partitions == 1) {
+        return compact_runs(spiller, 0) &&
+               merge_files_to<RunReader>(spiller.runs(0), output_file, unique, format);
     }
 
-    std::string output_file = argv[1];
+    std::vector<std::size_t> counts(partitions, 0);
+    std::atomic<bool> ok{true};
+    std::vector<std::thread> reducers;
+    for (unsigned r = 0; r < partitions; ++r) {
+        reducers.emplace_back([&, r] {
+            if (!compact_runs(spiller, r) ||
+                !merge_files_to<RunReader>(spiller.runs(r),
+                                           part_file_name(output_file, r),
+                                           counts[r], format)) {
+                ok = false;
+            }
+        });
+    }
+    for (auto &t : reducers) t.join();
 
-    std::vector<KeyValue> intermediate;
+    unique = 0;
+    for (auto c : counts) unique += c;
+    return ok;
+}
 
-    for (int i = 2; i < argc; ++i) {
-        std::string input_file = argv[i];
-        std::ifstream in(input_file);
-        if (!in) {
-            std::cerr << "Error: cannot open input file: "
-                      << input_file << "\n";
-            continue; 
+// --index: builds the lookup index from the result just written, merging
+// the part files when there is no single output file.
+template <typename Source>
+bool index_files(const std::vector<std::string> &paths, ResultIndexWriter &index) {
+    std::vector<std::unique_ptr<Source>> sources;
+    for (const auto &path : paths) {
+        sources.push_back(std::make_unique<Source>(path));
+        if (!sources.back()->ok()) {
+            std::cerr << "Error: cannot read result file: " << path << "\n";
+            return false;
         }
+    }
+    kway_merge(sources, [&](const std::string &key, long long value) {
+        index.add(key, value);
+    });
+    return true;
+}
 
-        std::string line;
-        while (std::getline(in, line)) {
-            auto kvs = map_line(line);
-            intermediate.insert(intermediate.end(), kvs.begin(), kvs.end());
+bool write_index(const Options &opt) {
+    std::vector<std::string> paths;
+    if (opt.num_reducers == 1 || opt.merge_parts) {
+        paths.push_back(opt.output_file);
+    } else {
+        for (unsigned r = 0; r < opt.num_reducers; ++r) {
+            paths.push_back(part_file_name(opt.output_file, r));
         }
-        in.close();
     }
+    ResultIndexWriter index;
+    if (!index.open(opt.index_file)) {
+        std::cerr << "Error: " << index.error() << "\n";
+        return false;
+    }
+    bool read = opt.format == ResultFormat::Text
+        ? index_files<ResultFileReader>(paths, index)
+        : index_files<BinaryResultReader>(paths, index);
+    if (!read) return false;
+    if (!index.finish()) {
+        std::cerr << "Error: " << index.error() << "\n";
+        return false;
+    }
+    std::cout << "[MapReduce] Index of " << index.size() << " words written to: "
+              << opt.index_file << "\n";
+    return true;
+}
+
+void report_partitions(const std::string &output_file, unsigned partitions) {
+    std::cout << "[MapReduce] " << partitions << " partitions written to: "
+              << part_file_name(output_file, 0) << " ... "
+              << part_file_name(output_file, partitions - 1) << "\n";
+}
 
-    std::cout << "[MapReduce] Mapped " << intermediate.size()
+// Reduces every partition and writes the result: <output_file> for a single
+// reducer, otherwise one part file per reducer written from the reducer's
+// own thread, plus the optional merge into <output_file>.
+template <typename Job, typename Outputs>
+int reduce_and_write(Job &job, Outputs &outputs, const Options &opt) {
+    JobStats &stats = job.stats();
+    std::cout << "[MapReduce] Mapped " << stats.records
               << " key-value pairs.\n";
 
-    auto result = reduce_all(intermediate);
-    std::cout << "[MapReduce] Reduced to " << result.size()
+    const std::string &output_file = opt.output_file;
+    const unsigned partitions = opt.num_reducers;
+    std::vector<std::vector<KeyValue>> results(partitions);
+    std::vector<double> write_seconds(partitions, 0);
+    std::atomic<bool> ok{true};
+
+    job.reduce(outputs, [&](unsigned r, std::vector<KeyValue> &&result) {
+        results[r] = std::move(result);
+        if (partitions == 1) return;
+        Stopwatch timer;
+        if (!write_result(part_file_name(output_file, r), results[r], opt.format)) ok = false;
+        write_seconds[r] = timer.seconds();
+    });
+    // Part files are written inside the reduce phase; count them as writing.
+    double part_write = *std::max_element(write_seconds.begin(), write_seconds.end());
+    stats.reduce_seconds -= part_write;
+    stats.write_seconds += part_write;
+
+    std::size_t unique = 0;
+    for (const auto &part : results) unique += part.size();
+    std::cout << "[MapReduce] Reduced to " << unique
+              << " unique words.\n";
+    if (!ok) return 1;
+
+    Stopwatch timer;
+    if (partitions > 1) report_partitions(output_file, partitions);
+    if (partitions == 1 || opt.merge_parts) {
+        bool written = partitions == 1 ? write_result(output_file, results[0], opt.format)
+                                       : write_merged(output_file, results, opt.format);
+        if (!written) return 1;
+        std::cout << "[MapReduce] Result written to: " << output_file << "\n";
+    }
+    if (!opt.index_file.empty() && !write_index(opt)) return 1;
+    stats.write_seconds += timer.seconds();
+
+    return stats.report(opt.show_stats, opt.stats_json) ? 0 : 1;
+}
+
+int reduce_spilled_and_write(Spiller &spiller, std::vector<CountTable> &outputs,
+                             JobStats &stats, const Options &opt) {
+    std::cout << "[MapReduce] Mapped " << stats.records
+              << " key-value pairs.\n";
+
+    Stopwatch timer;
+    for (auto &table : outputs) spiller.spill(table);
+    std::cout << "[MapReduce] Spilled " << spiller.spills()
+              << " sorted runs to disk.\n";
+    if (spiller.failed()) return 1;
+
+    const std::string &output_file = opt.output_file;
+    const unsigned partitions = opt.num_reducers;
+    std::size_t unique = 0;
+    bool ok = reduce_spilled(spiller, partitions, output_file, opt.format, unique);
+    std::cout << "[MapReduce] Reduced to " << unique
+              << " unique words.\n";
+    // The final merge streams straight into the output files, so reduce and
+    // write cannot be told apart here.
+    stats.reduce_seconds += timer.seconds();
+    if (!ok) return 1;
+
+    if (partitions == 1) {
+        std::cout << "[MapReduce] Result written to: " << output_file << "\n";
+    } else {
+        report_partitions(output_file, partitions);
+        if (opt.merge_parts) {
+            Stopwatch write_timer;
+            std::vector<std::string> parts;
+            for (unsigned r = 0; r < partitions; ++r) {
+                parts.push_back(part_file_name(output_file, r));
+            }
+            bool merged = opt.format == ResultFormat::Text
+                ? merge_files_to<ResultFileReader>(parts, output_file, unique, opt.format)
+                : merge_files_to<BinaryResultReader>(parts, output_file, unique, opt.format);
+            if (!merged) return 1;
+            std::cout << "[MapReduce] Result written to: " << output_file << "\n";
+            stats.write_seconds += write_timer.seconds();
+        }
+    }
+    if (!opt.index_file.empty()) {
+        Stopwatch index_timer;
+        if (!write_index(opt)) return 1;
+        stats.write_seconds += index_timer.seconds();
+    }
+
+    return stats.report(opt.show_stats, opt.stats_json) ? 0 : 1;
+}
+
+// ---- Merge mode (--merge-results) ----
+//
+// The inputs are finished results (sorted "word count" lines, or records
+// in the --binary format), e.g. one per shard or per day. They are merged
+// with kway_merge, summing the counts of equal words, so nothing is read
+// twice or re-tokenized and memory is one record and one read buffer per
+// input. More than kMaxFanIn inputs are merged in groups into temporary
+// binary files first.
+
+// Counts the records of a source and stops it at the first key that is
+// smaller than the one before: merging an unsorted input would silently
+// produce repeated words.
+template <typename Source>
+class CheckedSource {
+public:
+    explicit CheckedSource(const std::string &path) : src_(path), path_(path) {}
+
+    bool ok() const { return src_.ok(); }
+
+    bool next(std::string &key, long long &value) {
+        if (!src_.next(key, value)) return false;
+        if (records_ > 0 && key < last_) {
+            std::cerr << "Error: " << path_ << " is not sorted (\"" << key
+                      << "\" after \"" << last_ << "\")\n";
+            sorted_ = false;
+            return false;
+        }
+        last_ = key;
+        ++records_;
+        return true;
+    }
+
+    bool sorted() const { return sorted_; }
+    std::size_t records() const { return records_; }
+
+private:
+    Source src_;
+    std::string path_;
+    std::string last_;
+    std::size_t records_ = 0;
+    bool sorted_ = true;
+};
+
+template <typename Source>
+bool merge_results(const std::vector<std::string> &paths, const std::string &output_path,
+                   ResultFormat format, std::size_t &records, std::size_t &unique) {
+    std::vector<std::unique_ptr<CheckedSource<Source>>> sources;
+    for (const auto &path : paths) {
+        sources.push_back(std::make_unique<CheckedSource<Source>>(path));
+        if (!sources.back()->ok()) {
+            std::cerr << "Error: cannot open result file: " << path << "\n";
+            return false;
+        }
+    }
+    ResultWriter out(format);
+    if (!out.open(output_path)) return false;
+    unique = kway_merge(sources, [&](const std::string &key, long long value) {
+        out.record(key, value);
+    });
+    for (const auto &src : sources) {
+        if (!src->sorted()) return false;
+        records += src->records();
+    }
+    return out.close();
+}
+
+int run_merge_results(const Options &opt) {
+    JobStats stats;
+    for (const auto &path : opt.input_files) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0) stats.input_bytes += static_cast<std::size_t>(st.st_size);
+    }
+
+    Stopwatch timer;
+    std::string dir = default_spill_dir(opt);
+    std::vector<std::string> paths = opt.input_files, temps;
+    bool text = opt.format == ResultFormat::Text;
+    bool ok = true;
+    std::size_t unique = 0, records = 0;
+    while (ok && paths.size() > kMaxFanIn) {
+        std::vector<std::string> merged;
+        for (std::size_t i = 0; ok && i < paths.size(); i += kMaxFanIn) {
+            std::vector<std::string> group(paths.begin() + i,
+                                           paths.begin() + std::min(paths.size(), i + kMaxFanIn));
+            std::string tmpl = dir + "/wordcount-merge-XXXXXX";
+            int fd = ::mkstemp(&tmpl[0]);
+            if (fd < 0) {
+                std::cerr << "Error: cannot create a temporary file in " << dir << "\n";
+                ok = false;
+                break;
+            }
+            ::close(fd);
+            temps.push_back(tmpl);
+            merged.push_back(tmpl);
+            std::size_t group_records = 0;
+            ok = text ? merge_results<ResultFileReader>(group, tmpl, ResultFormat::Binary,
+                                                        group_records, unique)
+                      : merge_results<BinaryResultReader>(group, tmpl, ResultFormat::Binary,
+                                                          group_records, unique);
+            if (temps.size() == merged.size()) records += group_records;  // first pass
+        }
+        paths.swap(merged);
+        text = false;
+    }
+    if (ok) {
+        std::size_t final_records = 0;
+        ok = text ? merge_results<ResultFileReader>(paths, opt.output_file, opt.format,
+                                                    final_records, unique)
+                  : merge_results<BinaryResultReader>(paths, opt.output_file, opt.format,
+                                                      final_records, unique);
+        // Records of temporary files were counted when they were written.
+        if (temps.empty()) records = final_records;
+    }
+    for (const auto &path : temps) std::remove(path.c_str());
+    stats.records = records;
+    stats.reduce_seconds = timer.seconds();
+    if (!ok) return 1;
+
+    std::cout << "[MapReduce] Merged " << records << " records from "
+              << opt.input_files.size() << " result files into " << unique
               << " unique words.\n";
+    std::cout << "[MapReduce] Result written to: " << opt.output_file << "\n";
+    if (!opt.index_file.empty()) {
+        Stopwatch index_timer;
+        if (!write_index(opt)) return 1;
+        stats.write_seconds += index_timer.seconds();
+    }
+    return stats.report(opt.show_stats, opt.stats_json) ? 0 : 1;
+}
+
+// ---- Incremental mode (--cache) ----
+//
+// <dir>/index records every cached input, keyed by its real path:
+//   wordcount-cache 1 <generation>
+//   <size> <mtime_ns> <content_hash> <tokens> <path>
+// The counts of one input live in <dir>/<path hash>-<content hash>.run and
+// their sum in <dir>/total-<generation>.run (run format). An input is
+// re-mapped only if its size changed, or its mtime changed and so did its
+// content hash; the total is patched by subtracting the old counts of
+// changed or removed inputs and adding the new ones. Renaming the new index
+// into place commits a run, so an interrupted run leaves the old cache valid.
+
+struct CacheEntry {
+    std::uint64_t size = 0;
+    std::int64_t mtime_ns = 0;
+    std::uint64_t content_hash = 0;
+    std::uint64_t tokens = 0;
+    std::string path;
+};
+
+struct CacheIndex {
+    std::uint64_t generation = 0;
+    std::vector<CacheEntry> entries;
+};
+
+std::string hex64(std::uint64_t v) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+    return buf;
+}
+
+std::string cache_run_path(const std::string &dir, const CacheEntry &e) {
+    return dir + "/" + hex64(fnv1a(e.path)) + "-" + hex64(e.content_hash) + ".run";
+}
+
+std::string cache_total_path(const std::string &dir, std::uint64_t generation) {
+    return dir + "/total-" + std::to_string(generation) + ".run";
+}
+
+bool load_cache_index(const std::string &dir, CacheIndex &index) {
+    std::ifstream in(dir + "/index");
+    std::string magic;
+    int version = 0;
+    if (!(in >> magic >> version >> index.generation) ||
+        magic != "wordcount-cache" || version != 1) {
+        return false;
+    }
+    CacheEntry e;
+    unsigned long long size, hash, tokens;
+    long long mtime;
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+        int consumed = 0;
+        if (std::sscanf(line.c_str(), "%llu %lld %llx %llu %n",
+                        &size, &mtime, &hash, &tokens, &consumed) != 4 || consumed == 0) {
+            return false;
+        }
+        e.size = size;
+        e.mtime_ns = mtime;
+        e.content_hash = hash;
+        e.tokens = tokens;
+        e.path = line.substr(static_cast<std::size_t>(consumed));
+        index.entries.push_back(e);
+    }
+    return true;
+}
+
+bool save_cache_index(const std::string &dir, const CacheIndex &index) {
+    std::string tmp = dir + "/index.tmp";
+    {
+        std::ofstream out(tmp);
+        out << "wordcount-cache 1 " << index.generation << "\n";
+        for (const auto &e : index.entries) {
+            out << e.size << " " << e.mtime_ns << " " << hex64(e.content_hash)
+                << " " << e.tokens << " " << e.path << "\n";
+        }
+        if (!out.flush()) return false;
+    }
+    return std::rename(tmp.c_str(), (dir + "/index").c_str()) == 0;
+}
 
-    std::ofstream out(output_file);
-    if (!out) {
-        std::cerr << "Error: cannot open output file: "
-                  << output_file << "\n";
+// Adds sign * count for every record of a run file into `table`.
+bool load_run(const std::string &path, CountTable &table, int sign) {
+    RunReader in(path);
+    if (!in.ok()) return false;
+    std::string key;
+    long long value;
+    while (in.next(key, value)) table.add(key, sign * static_cast<int>(value));
+    return true;
+}
+
+// Writes the non-zero entries of `table` through a temporary file.
+bool save_run(const std::string &path, const CountTable &table) {
+    std::string tmp = path + ".tmp";
+    FILE *fp = std::fopen(tmp.c_str(), "wb");
+    if (!fp) return false;
+    std::setvbuf(fp, nullptr, _IOFBF, kStreamBuffer);
+    table.for_each([&](std::string_view key, std::uint64_t, int value) {
+        if (value != 0) write_record(fp, key, value);
+    });
+    if (std::fclose(fp) != 0 || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::uint64_t file_content_hash(const std::string &path) {
+    MappedFile mf(path);
+    return mf.ok() ? fnv1a(std::string_view(mf.data(), mf.size())) : 0;
+}
+
+// Maps one input with the job's workers and folds the per-worker tables.
+CountTable map_one_file(MapReduceJob<TableMapper, CountTable, TableReducer> &job,
+                        const std::string &path, std::uint64_t &tokens) {
+    std::size_t before = job.stats().records;
+    std::vector<CountTable> outputs = job.map({path});
+    tokens = job.stats().records - before;
+    CountTable table = std::move(outputs[0]);
+    for (std::size_t t = 1; t < outputs.size(); ++t) table.merge(outputs[t]);
+    return table;
+}
+
+int run_incremental(const Options &opt) {
+    const std::string &dir = opt.cache_dir;
+    if (::mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        std::cerr << "Error: cannot create cache directory: " << dir << "\n";
         return 1;
     }
 
-    for (const auto &kv : result) {
-        out << kv.key << " " << kv.value << "\n";
+    CacheIndex old_index;
+    bool have_old = load_cache_index(dir, old_index);
+    std::unordered_map<std::string, const CacheEntry *> cached;
+    if (have_old) {
+        for (const auto &e : old_index.entries) cached[e.path] = &e;
     }
-    out.close();
 
-    std::cout << "[MapReduce] Result written to: " << output_file << "\n";
-    return 0;
+    // Decide per input whether its cached counts are still good. Inputs that
+    // are not regular files (pipes, devices) are mapped fresh every run.
+    CacheIndex index;
+    index.generation = old_index.generation + 1;
+    std::vector<bool> reused;
+    std::vector<std::string> uncached;
+    std::unordered_map<std::string, bool> listed;
+    for (const auto &input_file : opt.input_files) {
+        struct stat st;
+        char *real = ::realpath(input_file.c_str(), nullptr);
+        std::string path = real ? real : input_file;
+        std::free(real);
+        if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+            path.find('\n') != std::string::npos) {
+            uncached.push_back(input_file);
+            continue;
+        }
+        if (listed[path]) {
+            uncached.push_back(input_file);  // listed twice, counted twice
+            continue;
+        }
+        listed[path] = true;
+
+        CacheEntry e;
+        e.path = path;
+        e.size = static_cast<std::uint64_t>(st.st_size);
+        e.mtime_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                     st.st_mtim.tv_nsec;
+        bool hit = false;
+        auto it = cached.find(path);
+        if (it != cached.end() && it->second->size == e.size) {
+            const CacheEntry &old = *it->second;
+            if (old.mtime_ns == e.mtime_ns) {
+                e.content_hash = old.content_hash;
+                hit = true;
+            } else {
+                e.content_hash = file_content_hash(path);
+                hit = e.content_hash == old.content_hash;
+            }
+            if (hit) e.tokens = old.tokens;
+        }
+        index.entries.push_back(e);
+        reused.push_back(hit);
+    }
+
+    // Start from the cached total and take out every input that is not
+    // reused as is. Without a usable total, rebuild it from the reused runs.
+    CountTable total;
+    bool have_total = have_old &&
+                      load_run(cache_total_path(dir, old_index.generation), total, 1);
+    if (have_total) {
+        std::unordered_map<std::string, bool> kept;
+        for (std::size_t i = 0; i < index.entries.size(); ++i) {
+            if (reused[i]) kept[index.entries[i].path] = true;
+        }
+        for (const auto &old : old_index.entries) {
+            if (kept.count(old.path)) continue;
+            if (!load_run(cache_run_path(dir, old), total, -1)) {
+                have_total = false;
+                break;
+            }
+        }
+    }
+    if (!have_total) {
+        total.clear();
+        for (std::size_t i = 0; i < index.entries.size(); ++i) {
+            if (reused[i] && !load_run(cache_run_path(dir, index.entries[i]), total, 1)) {
+                reused[i] = false;
+            }
+        }
+    }
+
+    JobOptions job_opt;
+    job_opt.threads = opt.num_threads;
+    job_opt.partitions = opt.num_reducers;
+    job_opt.use_mmap = opt.use_mmap;
+    job_opt.pipeline = opt.pipeline;
+    job_opt.io_uring = opt.use_io_uring;
+    job_opt.io_buffers = opt.io_buffers;
+    TableReducer reducer;
+    reducer.sorted = opt.sorted_output;
+    reducer.sort_threads = opt.sort_threads;
+    MapReduceJob<TableMapper, CountTable, TableReducer> job(job_opt, TableMapper(), reducer);
+
+    std::size_t hits = 0, reused_tokens = 0;
+    bool ok = true;
+    for (std::size_t i = 0; i < index.entries.size(); ++i) {
+        CacheEntry &e = index.entries[i];
+        if (reused[i]) {
+            ++hits;
+            reused_tokens += e.tokens;
+            continue;
+        }
+        if (e.content_hash == 0) e.content_hash = file_content_hash(e.path);
+        CountTable part = map_one_file(job, e.path, e.tokens);
+        if (!save_run(cache_run_path(dir, e), part)) ok = false;
+        total.merge(part);
+    }
+
+    // Drop words whose count went to zero, then store the new total.
+    CountTable pruned;
+    total.for_each([&](std::string_view key, std::uint64_t hash, int value) {
+        if (value != 0) pruned.add(key, hash, value);
+    });
+    total = std::move(pruned);
+    if (ok) ok = save_run(cache_total_path(dir, index.generation), total);
+    if (ok) ok = save_cache_index(dir, index);
+    if (ok) {
+        std::remove(cache_total_path(dir, old_index.generation).c_str());
+        std::unordered_map<std::string, bool> live;
+        for (const auto &e : index.entries) live[cache_run_path(dir, e)] = true;
+        for (const auto &old : old_index.entries) {
+            std::string run = cache_run_path(dir, old);
+            if (!live.count(run)) std::remove(run.c_str());
+        }
+    } else {
+        std::cerr << "Error: cannot update cache in " << dir << "\n";
+    }
+
+    std::cout << "[MapReduce] Cache: " << hits << " of " << index.entries.size()
+              << " inputs unchanged (" << reused_tokens
+              << " key-value pairs reused).\n";
+
+    std::vector<CountTable> outputs;
+    outputs.push_back(std::move(total));
+    if (!uncached.empty()) {
+        std::vector<CountTable> fresh = job.map(uncached);
+        for (auto &table : fresh) outputs[0].merge(table);
+    }
+    return reduce_and_write(job, outputs, opt);
+}
+
+// ---- Streaming mode (--stream) ----
+//
+// Reads stdin until EOF and counts words over a time window of --window
+// seconds that advances every --slide seconds (tumbling when the two are
+// equal). Words go into the pane (slide interval) they arrive in; when a
+// pane closes it is added to the window totals and the pane that falls out
+// of the window is subtracted, so nothing is ever recounted. After every
+// slide the current top words are written out. Memory is the distinct
+// words of one window plus its panes.
+
+// Top k entries of `table` by count (descending), then word.
+std::vector<KeyValue> top_entries(const CountTable &table, std::size_t k) {
+    std::vector<CountTable::Entry> entries;
+    table.for_each([&](std::string_view key, std::uint64_t hash, int value) {
+        if (value > 0) entries.push_back({key, hash, value});
+    });
+    auto by_count = [](const CountTable::Entry &a, const CountTable::Entry &b) {
+        if (a.value != b.value) return a.value > b.value;
+        return a.key < b.key;
+    };
+    k = std::min(k, entries.size());
+    std::partial_sort(entries.begin(), entries.begin() + k, entries.end(), by_count);
+    std::vector<KeyValue> out;
+    for (std::size_t i = 0; i < k; ++i) {
+        out.push_back({std::string(entries[i].key), entries[i].value});
+    }
+    return out;
+}
+
+class WindowCounter {
+public:
+    explicit WindowCounter(std::size_t panes) : panes_(panes) {}
+
+    CountTable &current() { return current_; }
+
+    // Closes the current pane: adds it to the totals and evicts the pane
+    // that has left the window.
+    void slide() {
+        totals_.merge(current_);
+        window_tokens_ += current_tokens_;
+        closed_.push_back({std::move(current_), current_tokens_});
+        current_ = CountTable();
+        current_tokens_ = 0;
+        if (closed_.size() > panes_) {
+            const Pane &old = closed_.front();
+            old.counts.for_each([&](std::string_view key, std::uint64_t hash, int value) {
+                totals_.add(key, hash, -value);
+            });
+            window_tokens_ -= old.tokens;
+            closed_.pop_front();
+            compact();
+        }
+    }
+
+    void count(std::size_t tokens) { current_tokens_ += tokens; }
+    const CountTable &totals() const { return totals_; }
+    std::size_t window_tokens() const { return window_tokens_; }
+
+private:
+    struct Pane {
+        CountTable counts;
+        std::size_t tokens;
+    };
+
+    // Words whose count dropped to zero stay in the table until they make
+    // up half of it; then the live ones are copied into a fresh table.
+    void compact() {
+        std::size_t zeros = 0;
+        totals_.for_each([&](std::string_view, std::uint64_t, int value) {
+            if (value == 0) ++zeros;
+        });
+        if (zeros * 2 <= totals_.size()) return;
+        CountTable live;
+        totals_.for_each([&](std::string_view key, std::uint64_t hash, int value) {
+            if (value != 0) live.add(key, hash, value);
+        });
+        totals_ = std::move(live);
+    }
+
+    std::size_t panes_;
+    CountTable current_;
+    std::size_t current_tokens_ = 0;
+    std::deque<Pane> closed_;
+    CountTable totals_;
+    std::size_t window_tokens_ = 0;
+};
+
+// Writes one snapshot: a header line, then "word count" lines. A file is
+// replaced atomically so readers never see a partial snapshot.
+bool emit_window(const Options &opt, double window_end, bool final,
+                 const std::vector<KeyValue> &top, std::size_t tokens) {
+    double window_start = std::max(0.0, window_end - opt.window_seconds);
+    char header[128];
+    std::snprintf(header, sizeof(header), "# window %.3f-%.3f s, %zu words%s\n",
+                  window_start, window_end, tokens, final ? " (end of input)" : "");
+    if (opt.output_file == "-") {
+        std::cout << header;
+        for (const auto &kv : top) std::cout << kv.key << " " << kv.value << "\n";
+        std::cout.flush();
+        return static_cast<bool>(std::cout);
+    }
+    std::string tmp = opt.output_file + ".tmp";
+    ResultWriter out;
+    if (!out.open(tmp)) return false;
+    out.append(header);
+    for (const auto &kv : top) out.record(kv.key, kv.value);
+    return out.close() && std::rename(tmp.c_str(), opt.output_file.c_str()) == 0;
+}
+
+int run_stream(const Options &opt) {
+    using Clock = std::chrono::steady_clock;
+    const double slide = opt.slide_seconds > 0 ? opt.slide_seconds : opt.window_seconds;
+    const std::size_t panes = static_cast<std::size_t>(std::ceil(opt.window_seconds / slide - 1e-9));
+    const std::size_t k = opt.top_k > 0 ? opt.top_k : 10;
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(slide));
+
+    WindowCounter window(std::max<std::size_t>(panes, 1));
+    std::vector<char> buf(1 << 16);
+    std::size_t held = 0;  // bytes of an unfinished word kept from the last read
+    std::string scratch;
+    const auto start = Clock::now();
+    auto next_slide = start + interval;
+    bool eof = false;
+
+    auto close_pane = [&](bool final) {
+        window.slide();
+        double now = std::chrono::duration<double>(Clock::now() - start).count();
+        return emit_window(opt, now, final, top_entries(window.totals(), k),
+                           window.window_tokens());
+    };
+
+    while (!eof) {
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_slide - Clock::now());
+        pollfd pfd{STDIN_FILENO, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, static_cast<int>(std::max<long long>(0, wait.count()) + 1));
+        if (ready < 0 && errno != EINTR) {
+            std::perror("Error: poll");
+            return 1;
+        }
+        if (ready > 0) {
+            ssize_t n = ::read(STDIN_FILENO, buf.data() + held, buf.size() - held);
+            if (n < 0 && errno != EINTR && errno != EAGAIN) {
+                std::perror("Error: read");
+                return 1;
+            }
+            if (n == 0) eof = true;
+            std::size_t end = held + static_cast<std::size_t>(std::max<ssize_t>(n, 0));
+            // Hold back a word that may continue in the next read, unless
+            // it fills the whole buffer.
+            std::size_t cut = end;
+            if (!eof) {
+                while (cut > 0 && is_word_byte(buf[cut - 1])) --cut;
+                if (cut == 0 && end == buf.size()) cut = end;
+            }
+            CountTable &pane = window.current();
+            window.count(map_line(buf.data(), buf.data() + cut, scratch,
+                                  [&](std::string_view w) { pane.add(w); }));
+            held = end - cut;
+            std::memmove(buf.data(), buf.data() + cut, held);
+        }
+        while (!eof && Clock::now() >= next_slide) {
+            if (!close_pane(false)) return 1;
+            next_slide += interval;
+        }
+    }
+    return close_pane(true) ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!select_tokenizer(opt.tokenizer)) {
+        std::cerr << "Error: tokenizer not available on this CPU: "
+                  << opt.tokenizer << "\n";
+        return 1;
+    }
+    g_token_filter.builtin_stopwords = opt.stopwords;
+    g_token_filter.stem = opt.stem;
+    if (!opt.stopword_file.empty() && !g_token_filter.load_stopwords(opt.stopword_file)) {
+        return 1;
+    }
+
+    if (opt.stream) {
+        return run_stream(opt);
+    }
+
+    if (opt.top_k > 0) {
+        return run_top_k(opt.top_k, opt.top_exact, opt.sketch_width,
+                         opt.input_files, opt.output_file, opt.format);
+    }
+
+    if (!opt.cache_dir.empty()) {
+        return run_incremental(opt);
+    }
+
+    if (opt.merge_results) {
+        return run_merge_results(opt);
+    }
+
+    JobOptions job_opt;
+    job_opt.threads = opt.num_threads;
+    job_opt.partitions = opt.num_reducers;
+    job_opt.use_mmap = opt.use_mmap;
+    job_opt.pipeline = opt.pipeline;
+    job_opt.io_uring = opt.use_io_uring;
+    job_opt.io_buffers = opt.io_buffers;
+
+    if (!opt.hash_combine) {
+        PairMapper mapper;
+        mapper.partitions = opt.num_reducers;
+        PairReducer reducer;
+        reducer.sort_threads = opt.sort_threads;
+        MapReduceJob<PairMapper, PairBuckets, PairReducer> job(job_opt, mapper, reducer);
+        auto outputs = job.map(opt.input_files);
+        return reduce_and_write(job, outputs, opt);
+    }
+
+    std::unique_ptr<Spiller> spiller;
+    if (opt.memory_budget > 0) {
+        spiller = std::make_unique<Spiller>(default_spill_dir(opt), opt.num_reducers);
+        job_opt.max_chunk = kSpillChunk;
+    }
+
+    TableReducer reducer;
+    reducer.sorted = opt.sorted_output;
+    reducer.sort_threads = opt.sort_threads;
+    MapReduceJob<TableMapper, CountTable, TableReducer> job(job_opt, TableMapper(), reducer);
+    if (spiller) {
+        const std::size_t table_limit = opt.memory_budget / opt.num_threads;
+        job.on_chunk([&](CountTable &table) {
+            maybe_spill(table, table_limit, spiller.get());
+        });
+    }
+    auto outputs = job.map(opt.input_files);
+
+    if (spiller && spiller->spills() > 0) {
+        return reduce_spilled_and_write(*spiller, outputs, job.stats(), opt);
+    }
+    return reduce_and_write(job, outputs, opt);
 }
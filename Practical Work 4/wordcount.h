@@ -0,0 +1,381 @@
+#ifndef WORDCOUNT_H
+#define WORDCOUNT_H
+
+// Pieces shared by wordcount.cpp and mpi_wordcount.cpp: the tokenizer, the
+// combiner table, partition/output helpers and the count record format.
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <cstdio>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "../common/mapreduce.h"
+#include "../common/parallel_sort.h"
+#include "../common/result_io.h"
+#include "../common/string_arena.h"
+
+struct KeyValue {
+    std::string key;
+    int value;
+};
+
+// ---- Tokenizer ----
+//
+// A word is a maximal run of ASCII letters and digits, lowercased; every
+// other byte (including bytes >= 0x80) separates words. This is exactly what
+// std::isalnum/std::tolower give in the default "C" locale, but without the
+// per-byte locale lookups. Input is classified 64 bytes at a time: the kernel
+// writes the lowercased block and returns a bitmask of word bytes, and the
+// driver walks runs of set bits.
+
+struct CharTables {
+    bool word[256];
+    unsigned char lower[256];
+
+    CharTables() {
+        for (int c = 0; c < 256; ++c) {
+            bool digit = c >= '0' && c <= '9';
+            bool upper = c >= 'A' && c <= 'Z';
+            bool low = c >= 'a' && c <= 'z';
+            word[c] = digit || upper || low;
+            lower[c] = static_cast<unsigned char>(upper ? c + 32 : c);
+        }
+    }
+};
+
+inline const CharTables kChars;
+
+inline bool is_word_byte(char c) {
+    return kChars.word[static_cast<unsigned char>(c)];
+}
+
+using ClassifyFn = std::uint64_t (*)(const unsigned char *in,
+                                     unsigned char *lower);
+
+inline std::uint64_t classify64_scalar(const unsigned char *in, unsigned char *lower) {
+    std::uint64_t mask = 0;
+    for (int i = 0; i < 64; ++i) {
+        mask |= static_cast<std::uint64_t>(kChars.word[in[i]]) << i;
+        lower[i] = kChars.lower[in[i]];
+    }
+    return mask;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// PCMPESTRM with range pairs 0-9, A-Z, a-z gives the word mask directly.
+__attribute__((target("sse4.2")))
+inline std::uint64_t classify64_sse42(const unsigned char *in, unsigned char *lower) {
+    const __m128i ranges = _mm_setr_epi8('0', '9', 'A', 'Z', 'a', 'z',
+                                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i upper_bias = _mm_set1_epi8(static_cast<char>(0x80 - 'A'));
+    const __m128i upper_limit = _mm_set1_epi8(static_cast<char>(-128 + 26));
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    std::uint64_t mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * i));
+        __m128i m = _mm_cmpestrm(ranges, 6, v, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK);
+        mask |= static_cast<std::uint64_t>(
+                    static_cast<std::uint32_t>(_mm_cvtsi128_si32(m)) & 0xFFFF)
+                << (16 * i);
+        __m128i is_upper = _mm_cmplt_epi8(_mm_add_epi8(v, upper_bias), upper_limit);
+        v = _mm_or_si128(v, _mm_and_si128(is_upper, case_bit));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(lower + 16 * i), v);
+    }
+    return mask;
+}
+
+// Range checks via the signed-bias trick: x is in [lo, lo + n) iff
+// (x + 0x80 - lo) as a signed byte is below -128 + n.
+__attribute__((target("avx2")))
+inline std::uint64_t classify64_avx2(const unsigned char *in, unsigned char *lower) {
+    const __m256i digit_bias = _mm256_set1_epi8(static_cast<char>(0x80 - '0'));
+    const __m256i digit_limit = _mm256_set1_epi8(static_cast<char>(-128 + 10));
+    const __m256i alpha_bias = _mm256_set1_epi8(static_cast<char>(0x80 - 'a'));
+    const __m256i upper_bias = _mm256_set1_epi8(static_cast<char>(0x80 - 'A'));
+    const __m256i alpha_limit = _mm256_set1_epi8(static_cast<char>(-128 + 26));
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    std::uint64_t mask = 0;
+    for (int i = 0; i < 2; ++i) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 32 * i));
+        __m256i digit = _mm256_cmpgt_epi8(digit_limit, _mm256_add_epi8(v, digit_bias));
+        __m256i folded = _mm256_or_si256(v, case_bit);
+        __m256i alpha = _mm256_cmpgt_epi8(alpha_limit, _mm256_add_epi8(folded, alpha_bias));
+        __m256i is_upper = _mm256_cmpgt_epi8(alpha_limit, _mm256_add_epi8(v, upper_bias));
+        mask |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(
+                    _mm256_movemask_epi8(_mm256_or_si256(digit, alpha))))
+                << (32 * i);
+        v = _mm256_or_si256(v, _mm256_and_si256(is_upper, case_bit));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(lower + 32 * i), v);
+    }
+    return mask;
+}
+#endif
+
+inline ClassifyFn g_classify = classify64_scalar;
+
+// Picks a kernel by name, or the widest one the CPU supports for "auto".
+inline bool select_tokenizer(const std::string &name) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool sse42 = __builtin_cpu_supports("sse4.2");
+    if (name == "auto") {
+        g_classify = avx2 ? classify64_avx2
+                   : sse42 ? classify64_sse42
+                   : classify64_scalar;
+        return true;
+    }
+    if (name == "avx2" && avx2) {
+        g_classify = classify64_avx2;
+        return true;
+    }
+    if (name == "sse4.2" && sse42) {
+        g_classify = classify64_sse42;
+        return true;
+    }
+#else
+    if (name == "auto") {
+        g_classify = classify64_scalar;
+        return true;
+    }
+#endif
+    if (name == "scalar") {
+        g_classify = classify64_scalar;
+        return true;
+    }
+    return false;
+}
+
+// Calls emit(std::string_view) for every word in [begin, end) and returns the
+// number of words. Views point into a block-local buffer (or `carry` for
+// words that cross a 64-byte block), so they are only valid during the call.
+template <typename Emit>
+std::size_t tokenize(const char *begin, const char *end, std::string &carry,
+                     Emit &&emit) {
+    alignas(64) unsigned char lower[64];
+    alignas(64) unsigned char tail[64];
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(begin);
+    const std::size_t n = static_cast<std::size_t>(end - begin);
+    std::size_t tokens = 0;
+    carry.clear();
+
+    for (std::size_t off = 0; off < n; off += 64) {
+        const unsigned char *block = in + off;
+        if (n - off < 64) {
+            // Zero padding is a separator, so the tail needs no extra masking.
+            std::memcpy(tail, block, n - off);
+            std::memset(tail + (n - off), 0, 64 - (n - off));
+            block = tail;
+        }
+        std::uint64_t m = g_classify(block, lower);
+
+        if (!carry.empty()) {
+            unsigned run = ~m == 0 ? 64 : static_cast<unsigned>(__builtin_ctzll(~m));
+            carry.append(reinterpret_cast<const char *>(lower), run);
+            if (run == 64) continue;
+            emit(std::string_view(carry));
+            ++tokens;
+            carry.clear();
+            m &= ~0ULL << run;
+        }
+
+        while (m) {
+            unsigned s = static_cast<unsigned>(__builtin_ctzll(m));
+            std::uint64_t rest = ~(m >> s);
+            unsigned run = rest == 0 ? 64 - s
+                                     : static_cast<unsigned>(__builtin_ctzll(rest));
+            if (s + run == 64) {
+                carry.assign(reinterpret_cast<const char *>(lower + s), run);
+                break;
+            }
+            emit(std::string_view(reinterpret_cast<const char *>(lower + s), run));
+            ++tokens;
+            m &= ~0ULL << (s + run);
+        }
+    }
+    if (!carry.empty()) {
+        emit(std::string_view(carry));
+        ++tokens;
+        carry.clear();
+    }
+    return tokens;
+}
+
+inline std::uint64_t hash_key(std::string_view key) {
+    return fnv1a(key);
+}
+
+// In-mapper combiner: words are interned once into an arena-backed table
+// that hands out dense 32-bit ids, and the counts live in a flat array
+// indexed by id. Iteration walks ids in first-seen order.
+class CountTable {
+public:
+    struct Entry {
+        std::string_view key;
+        std::uint64_t hash;
+        int value;
+    };
+
+    explicit CountTable(std::size_t capacity = 1024) : keys_(capacity) {}
+
+    void add(std::string_view key, int count = 1) {
+        add(key, hash_key(key), count);
+    }
+
+    void add(std::string_view key, std::uint64_t hash, int count) {
+        std::uint32_t id = keys_.intern(key, hash);
+        if (id == counts_.size()) {
+            counts_.push_back(count);
+        } else {
+            counts_[id] += count;
+        }
+    }
+
+    std::size_t size() const { return counts_.size(); }
+
+    std::size_t memory_bytes() const {
+        return keys_.memory_bytes() + counts_.capacity() * sizeof(int);
+    }
+
+    void clear() { *this = CountTable(); }
+
+    // Ids ordered by key bytes.
+    std::vector<std::uint32_t> sorted_ids(unsigned threads = 1) const {
+        std::vector<std::uint32_t> ids(counts_.size());
+        for (std::uint32_t id = 0; id < ids.size(); ++id) ids[id] = id;
+        parallel_sort(ids, [this](std::uint32_t id) { return keys_.key(id); }, threads);
+        return ids;
+    }
+
+    // Views into the table's arena, valid until clear().
+    std::vector<Entry> entries(bool sorted, unsigned threads = 1) const {
+        std::vector<Entry> out;
+        out.reserve(counts_.size());
+        if (sorted) {
+            for (std::uint32_t id : sorted_ids(threads)) out.push_back(entry(id));
+        } else {
+            for (std::uint32_t id = 0; id < counts_.size(); ++id) out.push_back(entry(id));
+        }
+        return out;
+    }
+
+    // Calls f(key, hash, value) for every entry, in first-seen order.
+    template <typename F>
+    void for_each(F &&f) const {
+        for (std::uint32_t id = 0; id < counts_.size(); ++id) {
+            f(keys_.key(id), keys_.hash(id), counts_[id]);
+        }
+    }
+
+    void merge(const CountTable &other) {
+        other.for_each([this](std::string_view key, std::uint64_t hash, int value) {
+            add(key, hash, value);
+        });
+    }
+
+    std::vector<KeyValue> to_vector(bool sorted, unsigned threads = 1) const {
+        std::vector<KeyValue> out;
+        out.reserve(counts_.size());
+        for (const auto &e : entries(sorted, threads)) {
+            out.push_back({std::string(e.key), e.value});
+        }
+        return out;
+    }
+
+private:
+    Entry entry(std::uint32_t id) const {
+        return {keys_.key(id), keys_.hash(id), counts_[id]};
+    }
+
+    InternTable keys_;
+    std::vector<int> counts_;
+};
+
+// Tokenizes raw bytes in place; the table copies a key only the first time
+// it sees it.
+inline std::size_t combine_range(const char *begin, const char *end,
+                          CountTable &table, std::string &scratch) {
+    return tokenize(begin, end, scratch,
+                    [&](std::string_view w) { table.add(w); });
+}
+
+// ---- Partitioning / output ----
+
+// Uses the high half of the hash so the partition is independent of the
+// slot index (low bits) inside each table.
+inline unsigned partition_of(std::uint64_t hash, unsigned partitions) {
+    return static_cast<unsigned>((hash >> 32) % partitions);
+}
+
+inline std::string part_file_name(const std::string &output_file, unsigned r) {
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".part-%05u", r);
+    return output_file + suffix;
+}
+
+inline bool write_result(const std::string &path, const std::vector<KeyValue> &result,
+                         ResultFormat format = ResultFormat::Text) {
+    ResultWriter out(format);
+    if (!out.open(path)) return false;
+    for (const auto &kv : result) {
+        out.record(kv.key, kv.value);
+    }
+    return out.close();
+}
+
+
+// ---- Count records ----
+//
+// Intermediate (key, count) records: the spill and cache runs of wordcount
+// and the shuffle buffers of mpi_wordcount. A record is a uint32 key length,
+// the key bytes and an int32 count, in host byte order.
+
+inline void write_record(FILE *fp, std::string_view key, int count) {
+    std::uint32_t len = static_cast<std::uint32_t>(key.size());
+    std::fwrite(&len, sizeof(len), 1, fp);
+    std::fwrite(key.data(), 1, key.size(), fp);
+    std::fwrite(&count, sizeof(count), 1, fp);
+}
+
+inline bool read_record(FILE *fp, std::string &key, int &count) {
+    std::uint32_t len;
+    if (std::fread(&len, sizeof(len), 1, fp) != 1) return false;
+    key.resize(len);
+    if (len > 0 && std::fread(&key[0], 1, len, fp) != len) return false;
+    return std::fread(&count, sizeof(count), 1, fp) == 1;
+}
+
+inline void append_record(std::vector<char> &buf, std::string_view key, int count) {
+    std::uint32_t len = static_cast<std::uint32_t>(key.size());
+    std::size_t at = buf.size();
+    buf.resize(at + sizeof(len) + key.size() + sizeof(count));
+    std::memcpy(&buf[at], &len, sizeof(len));
+    std::memcpy(&buf[at + sizeof(len)], key.data(), key.size());
+    std::memcpy(&buf[at + sizeof(len) + key.size()], &count, sizeof(count));
+}
+
+// Decodes the record at p and advances p past it; false if [p, end) does
+// not hold a whole record. The key points into the buffer.
+inline bool decode_record(const char *&p, const char *end, std::string_view &key, int &count) {
+    std::uint32_t len;
+    if (static_cast<std::size_t>(end - p) < sizeof(len)) return false;
+    std::memcpy(&len, p, sizeof(len));
+    if (static_cast<std::size_t>(end - p) - sizeof(len) < std::size_t{len} + sizeof(count)) {
+        return false;
+    }
+    key = std::string_view(p + sizeof(len), len);
+    std::memcpy(&count, p + sizeof(len) + len, sizeof(count));
+    p += sizeof(len) + len + sizeof(count);
+    return true;
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include "../common/result_index.h"
+
+// Point and prefix lookups over an index written by `wordcount --index`:
+//   g++ -std=c++17 -O2 wordcount_query.cpp -o wordcount_query
+//   ./wordcount_query output.idx the mapreduce        # one line per word
+//   ./wordcount_query --prefix map output.idx         # every word "map..."
+//   ./wordcount_query output.idx < words.txt           # one query per line
+//   ./wordcount_query --build output.txt output.idx    # index an existing result
+//
+// Answers are "word count" lines; a word that is not in the index gets
+// count 0. With no words on the command line, queries are read from stdin
+// until EOF, so one process can serve a stream of lookups.
+
+void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options] <index_file> [word ...]\n"
+              << "       " << prog << " --build <result_file> <index_file>\n"
+              << "Options:\n"
+              << "  --prefix       treat each query as a prefix and list every match\n"
+              << "  --limit N      with --prefix, at most N matches per query\n"
+              << "  --time         report the time per query on stderr\n";
+}
+
+// Indexes a text result ("word count" lines, sorted by word).
+int build_index(const std::string &result_file, const std::string &index_file) {
+    std::ifstream in(result_file);
+    if (!in) {
+        std::cerr << "Error: cannot open result file: " << result_file << "\n";
+        return 1;
+    }
+    ResultIndexWriter index;
+    bool ok = index.open(index_file);
+    std::string line;
+    while (ok && std::getline(in, line)) {
+        std::size_t sp = line.rfind(' ');
+        if (sp == std::string::npos) continue;
+        ok = index.add(std::string_view(line).substr(0, sp),
+                       std::strtoll(line.c_str() + sp + 1, nullptr, 10));
+    }
+    if (!ok || !index.finish()) {
+        std::cerr << "Error: " << index.error() << "\n";
+        return 1;
+    }
+    std::cout << "Indexed " << index.size() << " words into " << index_file << "\n";
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool prefix = false, timed = false;
+    unsigned long long limit = ~0ULL;
+    int i = 1;
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) break;
+        if (arg == "--build" && i + 2 < argc) {
+            return build_index(argv[i + 1], argv[i + 2]);
+        } else if (arg == "--prefix") {
+            prefix = true;
+        } else if (arg == "--limit" && i + 1 < argc) {
+            limit = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--time") {
+            timed = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (i >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    ResultIndex index(argv[i]);
+    if (!index.ok()) {
+        std::cerr << "Error: not a wordcount index: " << argv[i] << "\n";
+        return 1;
+    }
+
+    std::string out;
+    auto query = [&](std::string_view q) {
+        auto start = std::chrono::steady_clock::now();
+        out.clear();
+        if (prefix) {
+            auto range = index.prefix_range(q);
+            for (auto r = range.first; r < range.second && r - range.first < limit; ++r) {
+                out.append(index.key(r)).append(" ");
+                out.append(std::to_string(index.count(r))).append("\n");
+            }
+        } else {
+            auto r = index.find(q);
+            out.append(q).append(" ");
+            out.append(std::to_string(r == ResultIndex::kNotFound ? 0 : index.count(r)));
+            out.append("\n");
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << out;
+        if (timed) {
+            std::cerr << "[query] " << q << ": "
+                      << std::chrono::duration<double, std::micro>(elapsed).count()
+                      << " us\n";
+        }
+    };
+
+    if (i + 1 < argc) {
+        for (++i; i < argc; ++i) query(argv[i]);
+    } else {
+        std::string line;
+        while (std::getline(std::cin, line)) query(line);
+    }
+    return 0;
+}
@@ -2,111 +2,208 @@
 #include <fstream>
 #include <vector>
 #include <string>
-#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "../common/crawler.h"
+#include "../common/mapreduce.h"
+#include "../common/result_io.h"
+#include "longest_path.h"
+
+// Writes the summed per-length and per-depth counts, non-zero rows only.
+bool write_histograms(const std::string &path, const std::vector<LongestPaths> &outputs) {
+    ResultWriter out;
+    if (!out.open(path)) return false;
+    auto table = [&](const char *title, std::vector<std::size_t> LongestPaths::*counts) {
+        std::vector<std::size_t> sum;
+        for (const auto &o : outputs) {
+            const auto &c = o.*counts;
+            if (c.size() > sum.size()) sum.resize(c.size(), 0);
+            for (std::size_t i = 0; i < c.size(); ++i) sum[i] += c[i];
+        }
+        out.append(title);
+        for (std::size_t i = 0; i < sum.size(); ++i) {
+            if (sum[i] == 0) continue;
+            out.append_int(static_cast<long long>(i));
+            out.put(' ');
+            out.append_int(static_cast<long long>(sum[i]));
+            out.put('\n');
+        }
+    };
+    table("# length paths\n", &LongestPaths::length_counts);
+    table("# depth paths\n", &LongestPaths::depth_counts);
+    return out.close();
+}
+
+// ---- Job definitions for the MapReduce engine ----
 
-struct LengthPath {
-    int length;
-    std::string path;
+// One path per line; chunks are cut just after a newline.
+struct PathMapper {
+    std::size_t align(const char *data, std::size_t size, std::size_t pos) const {
+        const void *nl = std::memchr(data + pos, '\n', size - pos);
+        return nl ? static_cast<const char *>(nl) - data + 1 : size;
+    }
+
+    std::size_t map(const char *begin, const char *end, LongestPaths &out) {
+        return g_map_lines(begin, end, out);
+    }
 };
 
-LengthPath map_line(const std::string &line) {
-    LengthPath lp;
-    if (line.empty()) {
-        lp.length = -1;
-        lp.path = "";
-    } else {
-        lp.length = static_cast<int>(line.size());
-        lp.path = line;
+// Every worker already holds only its longest (or top K) paths; the reduce
+// keeps the workers with the overall maximum and sorts their ties, or
+// merges the heaps.
+struct PathReducer {
+    using Result = std::vector<LengthPath>;
+    unsigned sort_threads = 1;
+
+    Result reduce(std::vector<LongestPaths> &outputs, unsigned, unsigned) const {
+        if (g_report.top_k > 0) return reduce_top(outputs, g_report.top_k);
+        return reduce_all(outputs, sort_threads);
     }
-    return lp;
+};
+
+void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog
+              << " [options] <output_file> <input_file1> [input_file2 ...]\n"
+              << "       " << prog << " --crawl [options] <output_file> <dir1> [dir2 ...]\n"
+              << "Options:\n"
+              << "  --crawl        walk the given directory trees instead of reading path\n"
+              << "                 lists; paths are spelled as find(1) prints them\n"
+              << "  --mmap         memory-map inputs instead of reading them line by line\n"
+              << "  --threads N    map with N worker threads (implies --mmap)\n"
+              << "  --top K        write the K longest paths (ties by path) instead of every\n"
+              << "                 path of the maximum length\n"
+              << "  --histogram F  also write path counts per length and per depth to F\n"
+              << "  --scan K       newline search: auto | avx2 | sse2 | memchr (default auto)\n"
+              << "  --pipeline     read inputs on a separate I/O thread into a fixed pool of\n"
+              << "                 buffers that the map threads consume\n"
+              << "  --pread        with --pipeline, read with pread instead of io_uring\n"
+              << "  --stats        print per-phase timings and throughput\n"
+              << "  --stats-json F write the per-phase timings to F as JSON\n";
 }
 
-std::vector<LengthPath> reduce_all(std::vector<LengthPath> &intermediate) {
-    std::vector<LengthPath> result;
-    if (intermediate.empty()) return result;
-
-    intermediate.erase(
-        std::remove_if(intermediate.begin(), intermediate.end(),
-                       [](const LengthPath &lp){ return lp.length < 0; }),
-        intermediate.end()
-    );
-    if (intermediate.empty()) return result;
-
-    std::sort(intermediate.begin(), intermediate.end(),
-              [](const LengthPath &a, const LengthPath &b) {
-                  if (a.length != b.length) return a.length > b.length;
-                  return a.path < b.path; 
-              });
-
-    int maxLen = intermediate.front().length;
-    for (const auto &lp : intermediate) {
-        if (lp.length == maxLen) {
-            result.push_back(lp);
+int main(int argc, char *argv[]) {
+    JobOptions job_opt;
+    std::string scanner = "auto";
+    bool crawl = false;
+    std::string histogram_file;
+    bool show_stats = false;
+    std::string stats_json;
+    int i = 1;
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) break;
+        if (arg == "--mmap") {
+            job_opt.use_mmap = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            char *end = nullptr;
+            unsigned long n = std::strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || n == 0) {
+                std::cerr << "Error: invalid value for --threads: " << argv[i] << "\n";
+                return 1;
+            }
+            job_opt.threads = static_cast<unsigned>(n);
+            job_opt.use_mmap = true;
+        } else if (arg == "--top" && i + 1 < argc) {
+            char *end = nullptr;
+            unsigned long long k = std::strtoull(argv[++i], &end, 10);
+            if (*end != '\0' || k == 0) {
+                std::cerr << "Error: invalid value for --top: " << argv[i] << "\n";
+                return 1;
+            }
+            g_report.top_k = static_cast<std::size_t>(k);
+        } else if (arg == "--histogram" && i + 1 < argc) {
+            histogram_file = argv[++i];
+            g_report.histograms = true;
+        } else if (arg == "--crawl") {
+            crawl = true;
+        } else if (arg == "--scan" && i + 1 < argc) {
+            scanner = argv[++i];
+        } else if (arg == "--pipeline") {
+            job_opt.pipeline = true;
+        } else if (arg == "--pread") {
+            job_opt.io_uring = false;
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg == "--stats-json" && i + 1 < argc) {
+            stats_json = argv[++i];
         } else {
-            break; 
+            print_usage(argv[0]);
+            return 1;
         }
     }
-    return result;
-}
-
-int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0]
-                  << " <output_file> <input_file1> [input_file2 ...]\n";
+    if (argc - i < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!select_scanner(scanner)) {
+        std::cerr << "Error: scanner not available on this CPU: " << scanner << "\n";
         return 1;
     }
 
-    std::string output_file = argv[1];
-
-    std::vector<LengthPath> intermediate;
-
-    for (int i = 2; i < argc; ++i) {
-        std::string input_file = argv[i];
-        std::ifstream in(input_file);
-        if (!in) {
-            std::cerr << "Error: cannot open input file: "
-                      << input_file << "\n";
-            continue;
+    std::string output_file = argv[i++];
+    std::vector<std::string> input_files(argv + i, argv + argc);
+
+    PathReducer reducer;
+    reducer.sort_threads = job_opt.threads;
+    MapReduceJob<PathMapper, LongestPaths, PathReducer> job(job_opt, PathMapper(), reducer);
+    std::vector<LongestPaths> outputs;
+    if (crawl) {
+        // Paths go from the directory walk straight into each thread's
+        // LongestPaths; nothing is written out in between.
+        Stopwatch timer;
+        DirectoryCrawler crawler(job_opt.threads);
+        outputs.resize(job_opt.threads);
+        std::vector<std::size_t> bytes(job_opt.threads, 0), mapped(job_opt.threads, 0);
+        crawler.crawl(input_files, [&](unsigned t, std::string_view path) {
+            mapped[t] += map_line(path, outputs[t]);
+            bytes[t] += path.size() + 1;
+        });
+        for (unsigned t = 0; t < job_opt.threads; ++t) {
+            job.stats().records += mapped[t];
+            job.stats().input_bytes += bytes[t];
         }
-
-        std::string line;
-        while (std::getline(in, line)) {
-            LengthPath lp = map_line(line);
-            if (lp.length >= 0) {
-                intermediate.push_back(lp);
-            }
+        job.stats().map_seconds = timer.seconds();
+        if (crawler.errors() > 0) {
+            std::cerr << "[MapReduce] " << crawler.errors()
+                      << " directories could not be read.\n";
         }
-        in.close();
+    } else {
+        outputs = job.map(input_files);
     }
 
-    std::cout << "[MapReduce] Mapped " << intermediate.size()
+    std::cout << "[MapReduce] Mapped " << job.stats().records
               << " path entries.\n";
 
-    auto result = reduce_all(intermediate);
+    std::vector<LengthPath> result;
+    job.reduce(outputs, [&](unsigned, std::vector<LengthPath> &&r) { result = std::move(r); });
 
     if (result.empty()) {
         std::cerr << "[MapReduce] No valid paths found.\n";
         return 1;
     }
 
-    std::cout << "[MapReduce] Longest length = "
-              << result.front().length
-              << ", number of longest paths = "
-              << result.size() << "\n";
-
-    std::ofstream out(output_file);
-    if (!out) {
-        std::cerr << "Error: cannot open output file: "
-                  << output_file << "\n";
-        return 1;
+    if (g_report.top_k > 0) {
+        std::cout << "[MapReduce] Top " << result.size() << " paths, lengths "
+                  << result.front().length << " to " << result.back().length << "\n";
+    } else {
+        std::cout << "[MapReduce] Longest length = "
+                  << result.front().length
+                  << ", number of longest paths = "
+                  << result.size() << "\n";
     }
 
-    for (const auto &lp : result) {
-        out << lp.length << " " << lp.path << "\n";
-    }
-    out.close();
+    Stopwatch timer;
+    if (!write_paths(output_file, result)) return 1;
+    job.stats().write_seconds = timer.seconds();
 
     std::cout << "[MapReduce] Result written to: "
               << output_file << "\n";
-    return 0;
+    if (!histogram_file.empty()) {
+        Stopwatch histogram_timer;
+        if (!write_histograms(histogram_file, outputs)) return 1;
+        job.stats().write_seconds += histogram_timer.seconds();
+        std::cout << "[MapReduce] Histograms written to: " << histogram_file << "\n";
+    }
+    return job.stats().report(show_stats, stats_json) ? 0 : 1;
 }
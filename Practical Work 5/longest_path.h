@@ -0,0 +1,253 @@
+#ifndef LONGEST_PATH_H
+#define LONGEST_PATH_H
+
+// Pieces shared by longest_path.cpp and mpi_longest_path.cpp: the
+// per-worker combiner, the line scanners, the final reduce and the output.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "../common/parallel_sort.h"
+#include "../common/result_io.h"
+
+struct LengthPath {
+    int length;
+    std::string path;
+};
+
+// ---- Streaming reduce ----
+//
+// Only the longest paths are written, so nothing else is ever stored: each
+// worker keeps the longest length seen so far and the paths of exactly that
+// length, and a longer path throws the ties away on the spot. Memory is
+// O(ties) however long the input is, and the only sort is of the final tie
+// set. Ties all have the same length, so they sit back to back in one
+// buffer whose capacity is reused when the maximum grows.
+//
+// With --top K a worker keeps its K best paths (longest first, then by
+// path bytes) in a bounded heap instead, and --histogram counts paths per
+// length and per depth (number of '/') in the same pass.
+
+struct PathReport {
+    std::size_t top_k = 0;   // 0: every path of the longest length
+    bool histograms = false;
+};
+
+// Set once in main before mapping.
+inline PathReport g_report;
+
+// Ranking of --top: longer first, equal lengths by path bytes.
+inline bool ranks_before(const LengthPath &a, const LengthPath &b) {
+    return a.length != b.length ? a.length > b.length : a.path < b.path;
+}
+
+struct LongestPaths {
+    int length = -1;
+    std::string ties;
+    std::vector<LengthPath> top;  // heap, worst-ranked path at the front
+    std::vector<std::size_t> length_counts;
+    std::vector<std::size_t> depth_counts;
+
+    void add(std::string_view path) {
+        if (g_report.histograms) count(path);
+        int len = static_cast<int>(path.size());
+        if (g_report.top_k > 0) {
+            add_top(path, len);
+            return;
+        }
+        if (len < length) return;
+        if (len > length) {
+            length = len;
+            ties.clear();
+        }
+        ties.append(path);
+    }
+
+    std::size_t count() const { return length > 0 ? ties.size() / length : 0; }
+    std::string_view path(std::size_t i) const {
+        return std::string_view(ties).substr(i * length, length);
+    }
+
+private:
+    void add_top(std::string_view path, int len) {
+        if (top.size() == g_report.top_k) {
+            const LengthPath &worst = top.front();
+            if (len < worst.length || (len == worst.length && path >= worst.path)) return;
+            std::pop_heap(top.begin(), top.end(), ranks_before);
+            top.back().length = len;
+            top.back().path.assign(path);
+        } else {
+            top.push_back({len, std::string(path)});
+        }
+        std::push_heap(top.begin(), top.end(), ranks_before);
+    }
+
+    void count(std::string_view path) {
+        std::size_t depth = static_cast<std::size_t>(std::count(path.begin(), path.end(), '/'));
+        if (path.size() >= length_counts.size()) length_counts.resize(path.size() + 1, 0);
+        if (depth >= depth_counts.size()) depth_counts.resize(depth + 1, 0);
+        ++length_counts[path.size()];
+        ++depth_counts[depth];
+    }
+};
+
+// The map function: one line is one path; empty lines are not paths.
+inline bool map_line(std::string_view line, LongestPaths &out) {
+    if (line.empty()) return false;
+    out.add(line);
+    return true;
+}
+
+// Ties of the overall longest length, ordered by path bytes.
+inline std::vector<LengthPath> reduce_all(const std::vector<LongestPaths> &outputs,
+                                   unsigned sort_threads = 1) {
+    int longest = -1;
+    for (const auto &out : outputs) longest = std::max(longest, out.length);
+
+    std::vector<std::string_view> ties;
+    for (const auto &out : outputs) {
+        if (out.length != longest) continue;
+        for (std::size_t i = 0; i < out.count(); ++i) ties.push_back(out.path(i));
+    }
+    parallel_sort(ties, [](std::string_view path) { return path; }, sort_threads);
+
+    std::vector<LengthPath> result;
+    result.reserve(ties.size());
+    for (auto path : ties) result.push_back({longest, std::string(path)});
+    return result;
+}
+
+// The K best paths over all workers' heaps, in rank order.
+inline std::vector<LengthPath> reduce_top(std::vector<LongestPaths> &outputs, std::size_t k) {
+    std::vector<LengthPath> result;
+    for (auto &out : outputs) {
+        std::move(out.top.begin(), out.top.end(), std::back_inserter(result));
+        out.top.clear();
+    }
+    std::size_t keep = std::min(k, result.size());
+    std::partial_sort(result.begin(), result.begin() + keep, result.end(), ranks_before);
+    result.resize(keep);
+    return result;
+}
+
+// ---- Line scanning ----
+//
+// Mapping is only finding line ends. The memchr scanner calls memchr once
+// per line; the block scanners compare 64 bytes at a time against '\n',
+// get a bitmask back and walk its set bits, so short lines cost a few
+// instructions each instead of a call. Lines shorter than the current
+// maximum stop at the length check in LongestPaths::add.
+
+using MapLinesFn = std::size_t (*)(const char *begin, const char *end, LongestPaths &out);
+
+inline std::size_t map_lines_memchr(const char *begin, const char *end, LongestPaths &out) {
+    std::size_t mapped = 0;
+    while (begin < end) {
+        const char *nl = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+        const char *line_end = nl ? nl : end;
+        mapped += map_line(std::string_view(begin, line_end - begin), out);
+        begin = line_end + 1;
+    }
+    return mapped;
+}
+
+// Mask(p) has bit i set if p[i] is a newline, for 64 bytes at p.
+template <std::uint64_t (*Mask)(const char *)>
+std::size_t map_lines_blocks(const char *begin, const char *end, LongestPaths &out) {
+    std::size_t mapped = 0;
+    const char *line = begin;
+    const char *p = begin;
+    for (; end - p >= 64; p += 64) {
+        for (std::uint64_t m = Mask(p); m; m &= m - 1) {
+            const char *nl = p + __builtin_ctzll(m);
+            mapped += map_line(std::string_view(line, nl - line), out);
+            line = nl + 1;
+        }
+    }
+    return mapped + map_lines_memchr(line, end, out);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+inline std::uint64_t newline_mask_sse2(const char *p) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    std::uint64_t mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+        mask |= static_cast<std::uint64_t>(
+                    static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl))))
+                << (16 * i);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+inline std::uint64_t newline_mask_avx2(const char *p) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, nl))) |
+           static_cast<std::uint64_t>(static_cast<std::uint32_t>(
+               _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, nl)))) << 32;
+}
+#endif
+
+inline MapLinesFn g_map_lines = map_lines_memchr;
+
+// Picks a scanner by name, or the widest one the CPU supports for "auto".
+inline bool select_scanner(const std::string &name) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool sse2 = __builtin_cpu_supports("sse2");
+    if (name == "auto") {
+        g_map_lines = avx2 ? map_lines_blocks<newline_mask_avx2>
+                    : sse2 ? map_lines_blocks<newline_mask_sse2>
+                    : map_lines_memchr;
+        return true;
+    }
+    if (name == "avx2" && avx2) {
+        g_map_lines = map_lines_blocks<newline_mask_avx2>;
+        return true;
+    }
+    if (name == "sse2" && sse2) {
+        g_map_lines = map_lines_blocks<newline_mask_sse2>;
+        return true;
+    }
+#else
+    if (name == "auto") {
+        g_map_lines = map_lines_memchr;
+        return true;
+    }
+#endif
+    if (name == "memchr") {
+        g_map_lines = map_lines_memchr;
+        return true;
+    }
+    return false;
+}
+
+// ---- Output ----
+
+// Writes one "length path" line per result (the longest_output.txt format).
+inline bool write_paths(const std::string &path, const std::vector<LengthPath> &result) {
+    ResultWriter out;
+    if (!out.open(path)) return false;
+    for (const auto &lp : result) {
+        out.append_int(lp.length);
+        out.put(' ');
+        out.append(lp.path);
+        out.put('\n');
+    }
+    return out.close();
+}
+
+#endif
@@ -0,0 +1,130 @@
+#include <mpi.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include "../common/mapreduce.h"
+#include "../common/mpi_split.h"
+#include "longest_path.h"
+
+// MPI build of longest_path:
+//   mpicxx -std=c++17 -O2 mpi_longest_path.cpp -o mpi_longest_path
+//   mpirun -np 4 ./mpi_longest_path longest_output.txt paths1.txt paths2.txt
+//
+// The inputs are treated as one byte stream split evenly across ranks, as in
+// mpi_wordcount. Each rank keeps only its own longest paths; an Allreduce
+// agrees on the overall maximum length, and only the ranks holding paths of
+// that length send them, gathered on rank 0, which sorts the ties and
+// writes the same file `longest_path` does.
+
+// Lines cut by a range boundary belong to the rank they start in.
+static std::size_t map_range(const FileRange &range, LongestPaths &out) {
+    MappedFile mf(range.path);
+    if (!mf.ok()) {
+        std::cerr << "Error: cannot map input file: " << range.path << "\n";
+        return 0;
+    }
+    const char *data = mf.data();
+    auto [b, e] = align_range(data, mf.size(), range, [](char c) { return c != '\n'; });
+    if (b >= e) return 0;
+    return g_map_lines(data + b, data + e, out);
+}
+
+// Concatenated ties of the ranks whose maximum is `longest`, on rank 0.
+static std::string gather_ties(const LongestPaths &local, int longest, int rank, int nranks) {
+    const std::string &ties = local.ties;
+    if (local.length == longest && ties.size() > static_cast<std::size_t>(INT_MAX)) {
+        std::cerr << "Error: ties on rank " << rank << " exceed 2 GB\n";
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int send_count = local.length == longest ? static_cast<int>(ties.size()) : 0;
+    std::vector<int> recv_counts(rank == 0 ? nranks : 0);
+    MPI_Gather(&send_count, 1, MPI_INT, recv_counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    std::vector<int> recv_displs(recv_counts.size(), 0);
+    long long recv_total = 0;
+    for (std::size_t r = 0; r < recv_counts.size(); ++r) {
+        recv_displs[r] = static_cast<int>(recv_total);
+        recv_total += recv_counts[r];
+    }
+    if (recv_total > INT_MAX) {
+        std::cerr << "Error: gathered ties exceed 2 GB\n";
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    std::string all(static_cast<std::size_t>(recv_total), '\0');
+    MPI_Gatherv(ties.data(), send_count, MPI_CHAR,
+                &all[0], recv_counts.data(), recv_displs.data(), MPI_CHAR,
+                0, MPI_COMM_WORLD);
+    return all;
+}
+
+int main(int argc, char *argv[]) {
+    int rank, nranks;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+    if (argc < 3) {
+        if (rank == 0) {
+            std::cerr << "Usage: " << argv[0]
+                      << " <output_file> <input_file1> [input_file2 ...]\n"
+                      << "Example: mpirun -np 4 " << argv[0]
+                      << " longest_output.txt paths1.txt paths2.txt\n";
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+    select_scanner("auto");
+
+    std::string output_file = argv[1];
+    std::vector<std::string> files(argv + 2, argv + argc);
+
+    std::vector<unsigned long long> sizes = broadcast_file_sizes(files, rank);
+
+    LongestPaths local;
+    unsigned long long mapped = 0;
+    for (const auto &range : assign_ranges(files, sizes, rank, nranks)) {
+        mapped += map_range(range, local);
+    }
+
+    // Ties may sit on several ranks, so every rank needs the maximum itself
+    // (MAXLOC would only name one of them).
+    int longest = -1;
+    unsigned long long total_mapped = 0;
+    MPI_Allreduce(&local.length, &longest, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Reduce(&mapped, &total_mapped, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    std::string ties = gather_ties(local, longest, rank, nranks);
+    local = LongestPaths();
+
+    int ok = 1;
+    if (rank == 0) {
+        std::cout << "[MapReduce] Mapped " << total_mapped
+                  << " path entries.\n";
+        if (longest <= 0) {
+            std::cerr << "[MapReduce] No valid paths found.\n";
+            ok = 0;
+        } else {
+            std::vector<LongestPaths> gathered(1);
+            gathered[0].length = longest;
+            gathered[0].ties = std::move(ties);
+            std::vector<LengthPath> result = reduce_all(gathered);
+            std::cout << "[MapReduce] Longest length = " << longest
+                      << ", number of longest paths = " << result.size() << "\n";
+
+            ok = write_paths(output_file, result);
+            if (ok) {
+                std::cout << "[MapReduce] Result written to: "
+                          << output_file << "\n";
+            }
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    MPI_Finalize();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,158 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include "../common/mapreduce.h"
+#include "../common/parallel_sort.h"
+#include "path_store.h"
+
+// Longest, top-K and subtree queries over a store written by --build:
+//   g++ -std=c++17 -O2 path_query.cpp -o path_query
+//   ./path_query --build paths.pst paths1.txt paths2.txt  # sort and front-code
+//   ./path_query paths.pst                                # longest paths
+//   ./path_query --top 10 paths.pst /home/suiikawaii      # 10 longest below a dir
+//   ./path_query --count paths.pst /usr /var              # paths per subtree
+//
+// Answers use the longest_output.txt format ("length path" lines). With no
+// directory on the command line the query covers the whole store.
+
+void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options] <store_file> [dir ...]\n"
+              << "       " << prog << " --build <store_file> <input_file1> [input_file2 ...]\n"
+              << "Options:\n"
+              << "  --top K        list the K longest paths (ties by path) instead of every\n"
+              << "                 path of the maximum length\n"
+              << "  --count        print the number of paths under each dir\n"
+              << "  --info         print the path count and the stored vs raw size\n"
+              << "  --time         report the time per query on stderr\n";
+}
+
+// Sorts the non-empty lines of the inputs and front-codes them into a store.
+int build_store(const std::string &store_file, const std::vector<std::string> &input_files) {
+    std::vector<std::unique_ptr<MappedFile>> mapped;
+    std::vector<std::string> streamed;
+    streamed.reserve(input_files.size());
+    std::vector<std::string_view> paths;
+    auto add_lines = [&](const char *p, const char *end) {
+        while (p < end) {
+            const char *nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            const char *line_end = nl ? nl : end;
+            if (line_end > p) paths.emplace_back(p, line_end - p);
+            p = line_end + 1;
+        }
+    };
+    for (const auto &input_file : input_files) {
+        auto mf = std::make_unique<MappedFile>(input_file);
+        if (mf->ok()) {
+            add_lines(mf->data(), mf->data() + mf->size());
+            mapped.push_back(std::move(mf));
+            continue;
+        }
+        std::ifstream in(input_file, std::ios::binary);
+        if (!in) {
+            std::cerr << "Error: cannot open input file: " << input_file << "\n";
+            return 1;
+        }
+        streamed.emplace_back((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        add_lines(streamed.back().data(), streamed.back().data() + streamed.back().size());
+    }
+    parallel_sort(paths, [](std::string_view path) { return path; }, 1);
+
+    PathStoreWriter store;
+    bool ok = store.open(store_file);
+    for (std::size_t i = 0; ok && i < paths.size(); ++i) ok = store.add(paths[i]);
+    if (!ok || !store.finish()) {
+        std::cerr << "Error: " << store.error() << "\n";
+        return 1;
+    }
+    std::cout << "Stored " << store.size() << " paths into " << store_file << " ("
+              << store.stored_bytes() << " bytes, " << store.raw_bytes()
+              << " bytes of path text)\n";
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool count = false, info = false, timed = false;
+    std::size_t top_k = 0;
+    int i = 1;
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) break;
+        if (arg == "--build" && i + 2 < argc) {
+            return build_store(argv[i + 1], std::vector<std::string>(argv + i + 2, argv + argc));
+        } else if (arg == "--top" && i + 1 < argc) {
+            char *end = nullptr;
+            unsigned long long k = std::strtoull(argv[++i], &end, 10);
+            if (*end != '\0' || k == 0) {
+                std::cerr << "Error: invalid value for --top: " << argv[i] << "\n";
+                return 1;
+            }
+            top_k = static_cast<std::size_t>(k);
+        } else if (arg == "--count") {
+            count = true;
+        } else if (arg == "--info") {
+            info = true;
+        } else if (arg == "--time") {
+            timed = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (i >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const std::string store_file = argv[i];
+    PathStore store(store_file);
+    if (!store.ok()) {
+        std::cerr << "Error: not a path store: " << store_file << "\n";
+        return 1;
+    }
+    if (info) {
+        std::cout << store.size() << " paths, " << store.stored_bytes() << " bytes stored, "
+                  << store.raw_bytes() << " bytes of path text\n";
+        return 0;
+    }
+
+    std::string out;
+    auto query = [&](std::string_view dir) {
+        auto start = std::chrono::steady_clock::now();
+        out.clear();
+        if (count) {
+            out.append(dir).append(" ");
+            out.append(std::to_string(store.count(dir))).append("\n");
+        } else {
+            for (const auto &lp : top_k > 0 ? store.top(dir, top_k) : store.longest(dir)) {
+                out.append(std::to_string(lp.length)).append(" ");
+                out.append(lp.path).append("\n");
+            }
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (store.corrupt()) {
+            std::cerr << "Error: corrupt path store: " << store_file << "\n";
+            return false;
+        }
+        std::cout << out;
+        if (timed) {
+            std::cerr << "[query] " << dir << ": "
+                      << std::chrono::duration<double, std::micro>(elapsed).count()
+                      << " us\n";
+        }
+        return true;
+    };
+
+    if (i + 1 < argc) {
+        for (++i; i < argc; ++i) {
+            if (!query(argv[i])) return 1;
+        }
+        return 0;
+    }
+    return query("") ? 0 : 1;
+}
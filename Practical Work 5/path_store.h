@@ -0,0 +1,345 @@
+#ifndef PATH_STORE_H
+#define PATH_STORE_H
+
+// Front-coded, memory-mappable store of a sorted path list.
+//
+// Layout (native endianness, sections 8-byte aligned):
+//   Header     magic "PATHST01", counts and section offsets
+//   data       the paths in sorted order, in blocks of kBlockSize
+//   blocks     Block[blocks]: data offset, entries, longest path length
+//
+// Inside a block every path is stored as varint(shared), varint(suffix
+// length), suffix bytes, where `shared` is the length of the prefix it has
+// in common with the previous path. The first path of a block has shared =
+// 0, so block heads can be read in place and binary searched. Sorted paths
+// from one filesystem share most of their directories with the previous
+// entry, so a path usually costs a few bytes of file name.
+//
+// Queries decode only the blocks they need: a subtree is a contiguous run
+// of blocks found by binary search on the heads, and the longest-length
+// field lets longest and top-K queries skip blocks that cannot contain a
+// result.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../common/file_map.h"
+#include "longest_path.h"
+
+namespace path_store {
+
+struct Header {
+    char magic[8];
+    std::uint64_t count;
+    std::uint64_t blocks;
+    std::uint64_t raw_bytes;  // sum of the path lengths
+    std::uint64_t data_offset;
+    std::uint64_t data_size;
+    std::uint64_t blocks_offset;
+};
+
+struct Block {
+    std::uint64_t offset;  // from the start of the data section
+    std::uint32_t count;
+    std::uint32_t longest;
+};
+
+constexpr char kMagic[8] = {'P', 'A', 'T', 'H', 'S', 'T', '0', '1'};
+constexpr std::uint32_t kBlockSize = 32;
+
+inline void put_varint(std::string &out, std::uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+// Reads one varint from [p, end); false if it runs past end or past ten
+// bytes.
+inline bool get_varint(const char *&p, const char *end, std::uint64_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        unsigned char c = static_cast<unsigned char>(*p++);
+        v |= static_cast<std::uint64_t>(c & 0x7F) << shift;
+        if (c < 0x80) return true;
+    }
+    return false;
+}
+
+// Subtree test: `dir` itself or a path below it. An empty dir matches
+// everything; a dir ending in '/' matches only paths below it.
+inline bool in_subtree(std::string_view path, std::string_view dir) {
+    if (path.compare(0, dir.size(), dir) != 0) return false;
+    return dir.empty() || dir.back() == '/' || path.size() == dir.size() ||
+           path[dir.size()] == '/';
+}
+
+} // namespace path_store
+
+// Builds a store from paths added in non-decreasing byte order (duplicates
+// are kept, as longest_path reports each line). Blocks are encoded in
+// memory and streamed to the file; only the block table (16 bytes per
+// kBlockSize paths) stays until finish().
+class PathStoreWriter {
+public:
+    PathStoreWriter() = default;
+    ~PathStoreWriter() {
+        if (fp_) std::fclose(fp_);
+    }
+    PathStoreWriter(const PathStoreWriter &) = delete;
+    PathStoreWriter &operator=(const PathStoreWriter &) = delete;
+
+    bool open(const std::string &path) {
+        fp_ = std::fopen(path.c_str(), "wb");
+        if (!fp_) return fail("cannot open store file: " + path);
+        std::setvbuf(fp_, nullptr, _IOFBF, 1 << 20);
+        path_store::Header header{};
+        std::fwrite(&header, sizeof(header), 1, fp_);
+        return true;
+    }
+
+    bool add(std::string_view path) {
+        using namespace path_store;
+        if (!error_.empty()) return false;
+        if (count_ > 0 && path < std::string_view(last_)) {
+            return fail("paths must be added in sorted order");
+        }
+        if (path.size() > 0xFFFFFFFFu) return fail("path too long for the store");
+        if (count_ % kBlockSize == 0) {
+            flush_block();
+            blocks_.push_back({data_size_, 0, 0});
+        }
+        Block &block = blocks_.back();
+        std::size_t shared = 0;
+        if (block.count > 0) {
+            std::size_t limit = std::min(path.size(), last_.size());
+            while (shared < limit && path[shared] == last_[shared]) ++shared;
+        }
+        put_varint(pending_, shared);
+        put_varint(pending_, path.size() - shared);
+        pending_.append(path.substr(shared));
+        block.longest = std::max(block.longest, static_cast<std::uint32_t>(path.size()));
+        ++block.count;
+        ++count_;
+        raw_bytes_ += path.size();
+        last_.assign(path.data(), path.size());
+        return true;
+    }
+
+    bool finish() {
+        using namespace path_store;
+        if (!error_.empty()) return false;
+        flush_block();
+        Header header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.count = count_;
+        header.blocks = blocks_.size();
+        header.raw_bytes = raw_bytes_;
+        header.data_offset = sizeof(Header);
+        header.data_size = data_size_;
+
+        static const char zeros[8] = {0};
+        std::uint64_t end = header.data_offset + data_size_;
+        header.blocks_offset = (end + 7) & ~std::uint64_t(7);
+        std::fwrite(zeros, 1, header.blocks_offset - end, fp_);
+        std::fwrite(blocks_.data(), sizeof(Block), blocks_.size(), fp_);
+
+        return write_header_last(fp_, &header, sizeof(header)) || fail("cannot write store file");
+    }
+
+    std::uint64_t size() const { return count_; }
+    std::uint64_t raw_bytes() const { return raw_bytes_; }
+    std::uint64_t stored_bytes() const {
+        return sizeof(path_store::Header) + data_size_ + blocks_.size() * sizeof(path_store::Block);
+    }
+    const std::string &error() const { return error_; }
+
+private:
+    bool fail(const std::string &message) {
+        if (error_.empty()) error_ = message;
+        return false;
+    }
+
+    void flush_block() {
+        std::fwrite(pending_.data(), 1, pending_.size(), fp_);
+        data_size_ += pending_.size();
+        pending_.clear();
+    }
+
+    FILE *fp_ = nullptr;
+    std::vector<path_store::Block> blocks_;
+    std::string pending_;
+    std::string last_;
+    std::uint64_t count_ = 0;
+    std::uint64_t raw_bytes_ = 0;
+    std::uint64_t data_size_ = 0;
+    std::string error_;
+};
+
+// Read-only view of a store file.
+class PathStore {
+public:
+    explicit PathStore(const std::string &path) : file_(path, sizeof(path_store::Header)) {
+        if (file_.ok() && !attach()) file_.close();
+    }
+
+    PathStore(const PathStore &) = delete;
+    PathStore &operator=(const PathStore &) = delete;
+
+    bool ok() const { return file_.ok(); }
+    std::uint64_t size() const { return header_.count; }
+    std::uint64_t raw_bytes() const { return header_.raw_bytes; }
+    std::uint64_t stored_bytes() const { return file_.size(); }
+    // Set once a query has met a block that does not decode; its answer
+    // is incomplete.
+    bool corrupt() const { return corrupt_; }
+
+    // Calls visit(path) for every path under `dir` (see in_subtree), in
+    // sorted order. Blocks whose longest path is shorter than `min_length`
+    // are skipped without decoding; the visitor may raise min_length as it
+    // goes. Returns the number of blocks decoded.
+    template <typename Visit>
+    std::uint64_t scan(std::string_view dir, const std::uint64_t &min_length,
+                       Visit &&visit) const {
+        using namespace path_store;
+        // The subtree starts in the last block whose head sorts before dir.
+        std::uint64_t lo = 0, hi = header_.blocks;
+        while (lo < hi) {
+            std::uint64_t mid = lo + (hi - lo) / 2;
+            if (head(mid) < dir) lo = mid + 1; else hi = mid;
+        }
+        std::uint64_t decoded = 0;
+        std::string path;
+        for (std::uint64_t b = lo > 0 ? lo - 1 : 0; b < header_.blocks; ++b) {
+            std::string_view first = head(b);
+            if (first > dir && first.compare(0, dir.size(), dir) != 0) break;
+            if (blocks_[b].longest < min_length) continue;
+            ++decoded;
+            const char *p = data_ + blocks_[b].offset;
+            const char *end = data_ + block_end(b);
+            path.clear();
+            for (std::uint32_t i = 0; i < blocks_[b].count; ++i) {
+                std::uint64_t shared, suffix;
+                if (!get_varint(p, end, shared) || !get_varint(p, end, suffix) ||
+                    shared > path.size() || suffix > static_cast<std::uint64_t>(end - p)) {
+                    corrupt_ = true;
+                    return decoded;
+                }
+                path.resize(shared);
+                path.append(p, suffix);
+                p += suffix;
+                if (in_subtree(path, dir)) visit(std::string_view(path));
+            }
+        }
+        return decoded;
+    }
+
+    // Every path of the greatest length under `dir`, in path order.
+    std::vector<LengthPath> longest(std::string_view dir) const {
+        std::vector<LengthPath> result;
+        std::uint64_t length = 0;
+        scan(dir, length, [&](std::string_view path) {
+            if (path.size() < length) return;
+            if (path.size() > length) {
+                length = path.size();
+                result.clear();
+            }
+            result.push_back({static_cast<int>(path.size()), std::string(path)});
+        });
+        return result;
+    }
+
+    // The k best paths under `dir` in --top order (ranks_before). Paths
+    // arrive sorted, so once the heap is full a path no longer than the
+    // worst entry cannot displace it, and neither can a block of them.
+    std::vector<LengthPath> top(std::string_view dir, std::size_t k) const {
+        std::vector<LengthPath> heap;
+        std::uint64_t threshold = 0;
+        if (k == 0) return heap;
+        scan(dir, threshold, [&](std::string_view path) {
+            int len = static_cast<int>(path.size());
+            if (heap.size() == k) {
+                if (len <= heap.front().length) return;
+                std::pop_heap(heap.begin(), heap.end(), ranks_before);
+                heap.back().length = len;
+                heap.back().path.assign(path);
+            } else {
+                heap.push_back({len, std::string(path)});
+            }
+            std::push_heap(heap.begin(), heap.end(), ranks_before);
+            if (heap.size() == k) threshold = static_cast<std::uint64_t>(heap.front().length) + 1;
+        });
+        std::sort(heap.begin(), heap.end(), ranks_before);
+        return heap;
+    }
+
+    // Number of paths under `dir`.
+    std::uint64_t count(std::string_view dir) const {
+        std::uint64_t n = 0;
+        const std::uint64_t all = 0;
+        scan(dir, all, [&](std::string_view) { ++n; });
+        return n;
+    }
+
+private:
+    // Blocks are laid out back to back, so a block ends where the next
+    // one starts.
+    std::uint64_t block_end(std::uint64_t b) const {
+        return b + 1 < header_.blocks ? blocks_[b + 1].offset : header_.data_size;
+    }
+
+    // First path of block b, stored whole; checked by attach().
+    std::string_view head(std::uint64_t b) const {
+        const char *p = data_ + blocks_[b].offset;
+        const char *end = data_ + block_end(b);
+        std::uint64_t shared = 0, length = 0;
+        path_store::get_varint(p, end, shared);
+        path_store::get_varint(p, end, length);
+        return std::string_view(p, length);
+    }
+
+    // Checks the header, the section bounds, the block table and every
+    // block head. The rest of each block is checked as it is decoded.
+    bool attach() {
+        using namespace path_store;
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, kMagic, sizeof(kMagic)) != 0) return false;
+        if (!file_.fits(header_.data_offset, header_.data_size) ||
+            header_.blocks > file_.size() / sizeof(Block) ||
+            !file_.fits(header_.blocks_offset, header_.blocks * sizeof(Block))) {
+            return false;
+        }
+        data_ = file_.data() + header_.data_offset;
+        blocks_ = reinterpret_cast<const Block *>(file_.data() + header_.blocks_offset);
+        for (std::uint64_t b = 0; b < header_.blocks; ++b) {
+            const Block &block = blocks_[b];
+            if (block.count == 0 || block.count > kBlockSize ||
+                (b == 0 ? block.offset != 0 : block.offset <= blocks_[b - 1].offset) ||
+                block.offset >= header_.data_size) {
+                return false;
+            }
+            const char *p = data_ + block.offset;
+            const char *end = data_ + block_end(b);
+            std::uint64_t shared, length;
+            if (!get_varint(p, end, shared) || !get_varint(p, end, length) || shared != 0 ||
+                length > static_cast<std::uint64_t>(end - p)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    ReadOnlyFile file_;
+    path_store::Header header_{};
+    const char *data_ = nullptr;
+    const path_store::Block *blocks_ = nullptr;
+    mutable bool corrupt_ = false;
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <random>
+#include <unordered_set>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+
+#include "../common/parse_size.h"
+
+// Synthetic inputs for the MapReduce benchmarks.
+//
+//   gen_corpus words <output> [--size SIZE] [--vocab N] [--zipf S]
+//                             [--line-words N] [--seed N]
+//   gen_corpus paths <output> [--count N] [--depth D] [--fanout N]
+//                             [--zipf S] [--seed N]
+//
+// Text is words drawn from a Zipfian distribution over a random vocabulary,
+// with some capitalisation and punctuation so the tokenizer has work to do.
+// Paths are /-separated components drawn from a Zipfian pool of directory
+// names, so common prefixes repeat the way they do on a real filesystem.
+// Output is deterministic for a given seed.
+
+struct GenOptions {
+    std::size_t size = 64 << 20;  // bytes of text
+    std::size_t vocab = 50000;
+    double zipf = 1.0;
+    std::size_t line_words = 12;  // mean words per line
+    std::size_t count = 1000000;  // paths
+    std::size_t depth = 8;        // max components per path
+    std::size_t fanout = 1000;    // distinct directory names
+    std::uint64_t seed = 1;
+};
+
+// Samples ranks 0..n-1 with P(k) proportional to 1 / (k + 1)^s.
+class ZipfSampler {
+public:
+    ZipfSampler(std::size_t n, double s) : cdf_(n) {
+        double sum = 0;
+        for (std::size_t k = 0; k < n; ++k) {
+            sum += 1.0 / std::pow(static_cast<double>(k + 1), s);
+            cdf_[k] = sum;
+        }
+        for (auto &c : cdf_) c /= sum;
+    }
+
+    template <typename Rng>
+    std::size_t operator()(Rng &rng) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+        return std::min<std::size_t>(it - cdf_.begin(), cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+// n distinct lowercase names of 2..12 letters.
+std::vector<std::string> make_names(std::size_t n, std::mt19937_64 &rng) {
+    std::uniform_int_distribution<int> len(2, 12), letter('a', 'z');
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> names;
+    names.reserve(n);
+    while (names.size() < n) {
+        std::string w(static_cast<std::size_t>(len(rng)), 'a');
+        for (auto &c : w) c = static_cast<char>(letter(rng));
+        if (seen.insert(w).second) names.push_back(w);
+    }
+    return names;
+}
+
+void generate_words(const GenOptions &opt, std::ostream &out) {
+    std::mt19937_64 rng(opt.seed);
+    std::vector<std::string> vocab = make_names(opt.vocab, rng);
+    ZipfSampler zipf(vocab.size(), opt.zipf);
+    std::uniform_int_distribution<std::size_t> words_per_line(1, 2 * opt.line_words - 1);
+    std::uniform_int_distribution<int> dice(0, 99);
+    static const char kPunct[] = ",.;:!?";
+
+    std::string line;
+    std::size_t written = 0;
+    while (written < opt.size) {
+        line.clear();
+        std::size_t n = words_per_line(rng);
+        for (std::size_t i = 0; i < n; ++i) {
+            if (i > 0) line += ' ';
+            std::size_t at = line.size();
+            line += vocab[zipf(rng)];
+            int roll = dice(rng);
+            if (roll < 10) line[at] = static_cast<char>(line[at] - 'a' + 'A');
+            if (roll >= 95) line += kPunct[roll % 6];
+        }
+        line += '\n';
+        out << line;
+        written += line.size();
+    }
+}
+
+void generate_paths(const GenOptions &opt, std::ostream &out) {
+    std::mt19937_64 rng(opt.seed);
+    std::vector<std::string> dirs = make_names(opt.fanout, rng);
+    ZipfSampler zipf(dirs.size(), opt.zipf);
+    std::uniform_int_distribution<std::size_t> depth(1, opt.depth);
+    static const char *const kExt[] = {".txt", ".log", ".cpp", ".h", ".pdf", ""};
+    std::uniform_int_distribution<int> ext(0, 5);
+
+    std::string path;
+    for (std::size_t i = 0; i < opt.count; ++i) {
+        path.clear();
+        std::size_t d = depth(rng);
+        for (std::size_t c = 0; c < d; ++c) {
+            path += '/';
+            path += dirs[zipf(rng)];
+        }
+        path += kExt[ext(rng)];
+        path += '\n';
+        out << path;
+    }
+}
+
+void print_usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " words <output> [options]\n"
+              << "       " << prog << " paths <output> [options]\n"
+              << "Options:\n"
+              << "  --size SIZE    words: bytes of text (K/M/G suffixes, default 64M)\n"
+              << "  --vocab N      words: vocabulary size (default 50000)\n"
+              << "  --line-words N words: mean words per line (default 12)\n"
+              << "  --count N      paths: number of paths (default 1000000)\n"
+              << "  --depth D      paths: max components per path (default 8)\n"
+              << "  --fanout N     paths: distinct directory names (default 1000)\n"
+              << "  --zipf S       Zipf exponent (default 1.0)\n"
+              << "  --seed N       random seed (default 1)\n";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    std::string mode = argv[1];
+    std::string output_file = argv[2];
+    if (mode != "words" && mode != "paths") {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    GenOptions opt;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << arg << " needs a value\n";
+            return 1;
+        }
+        const char *value = argv[++i];
+        unsigned long long n = std::strtoull(value, nullptr, 10);
+        if (arg == "--size") {
+            opt.size = parse_size(value);
+        } else if (arg == "--vocab") {
+            opt.vocab = n;
+        } else if (arg == "--line-words") {
+            opt.line_words = n;
+        } else if (arg == "--count") {
+            opt.count = n;
+        } else if (arg == "--depth") {
+            opt.depth = n;
+        } else if (arg == "--fanout") {
+            opt.fanout = n;
+        } else if (arg == "--zipf") {
+            opt.zipf = std::strtod(value, nullptr);
+        } else if (arg == "--seed") {
+            opt.seed = n;
+        } else {
+            std::cerr << "Error: unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (opt.size == 0 || opt.vocab == 0 || opt.line_words == 0 ||
+        opt.depth == 0 || opt.fanout == 0 || opt.zipf < 0) {
+        std::cerr << "Error: invalid generator options\n";
+        return 1;
+    }
+
+    std::vector<char> buf(1 << 20);
+    std::ofstream out;
+    out.rdbuf()->pubsetbuf(buf.data(), static_cast<std::streamsize>(buf.size()));
+    out.open(output_file);
+    if (!out) {
+        std::cerr << "Error: cannot open output file: " << output_file << "\n";
+        return 1;
+    }
+    if (mode == "words") {
+        generate_words(opt, out);
+    } else {
+        generate_paths(opt, out);
+    }
+    out.close();
+    if (!out) {
+        std::cerr << "Error: cannot write output file: " << output_file << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#!/bin/bash
+# Benchmarks wordcount (Practical Work 4) and longest_path (Practical Work 5)
+# on synthetic inputs and prints one JSON document with the per-phase
+# timings of every run.
+#
+# Usage: benchmark/run_bench.sh [size] [threads] [repeat] > results.json
+#   size     bytes of text to generate (K/M/G suffixes, default 64M)
+#   threads  worker threads for the parallel runs (default: nproc)
+#   repeat   runs per configuration (default 3)
+#
+# Environment: WORK (scratch directory, default /tmp/mapreduce_bench),
+# VOCAB, ZIPF, LINE_WORDS, PATHS, DEPTH, FANOUT, SEED tune the generators.
+# Compare two builds by running the script on each and diffing the rates.
+
+set -e
+
+SIZE=${1:-64M}
+THREADS=${2:-$(nproc)}
+REPEAT=${3:-3}
+WORK=${WORK:-/tmp/mapreduce_bench}
+VOCAB=${VOCAB:-50000}
+ZIPF=${ZIPF:-1.0}
+LINE_WORDS=${LINE_WORDS:-12}
+PATHS=${PATHS:-2000000}
+DEPTH=${DEPTH:-8}
+FANOUT=${FANOUT:-1000}
+SEED=${SEED:-1}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-std=c++17 -O2 -pthread"}
+
+mkdir -p "$WORK"
+cd "$WORK"
+
+echo "[*] Building..." >&2
+$CXX $CXXFLAGS "$ROOT/benchmark/gen_corpus.cpp" -o gen_corpus
+$CXX $CXXFLAGS "$ROOT/Practical Work 4/wordcount.cpp" -o wordcount
+$CXX $CXXFLAGS "$ROOT/Practical Work 5/longest_path.cpp" -o longest_path
+
+CORPUS="corpus-$SIZE-$VOCAB-$ZIPF-$LINE_WORDS-$SEED.txt"
+PATHLIST="paths-$PATHS-$DEPTH-$FANOUT-$ZIPF-$SEED.txt"
+if [ ! -f "$CORPUS" ]; then
+    echo "[*] Generating $CORPUS..." >&2
+    ./gen_corpus words "$CORPUS" --size "$SIZE" --vocab "$VOCAB" --zipf "$ZIPF" \
+        --line-words "$LINE_WORDS" --seed "$SEED"
+fi
+if [ ! -f "$PATHLIST" ]; then
+    echo "[*] Generating $PATHLIST..." >&2
+    ./gen_corpus paths "$PATHLIST" --count "$PATHS" --depth "$DEPTH" \
+        --fanout "$FANOUT" --zipf "$ZIPF" --seed "$SEED"
+fi
+
+first=1
+emit() {
+    # emit <program> <name> <args...>: one run, appended to the JSON array
+    local prog=$1 name=$2
+    shift 2
+    for r in $(seq 1 "$REPEAT"); do
+        ./"$prog" --stats-json stats.json "$@" >/dev/null
+        [ $first -eq 1 ] || echo ","
+        first=0
+        printf '    {"program": "%s", "config": "%s", "run": %d, "stats": %s}' \
+            "$prog" "$name" "$r" "$(cat stats.json)"
+    done
+}
+
+echo "{"
+echo "  \"corpus\": {\"file\": \"$CORPUS\", \"bytes\": $(stat -c %s "$CORPUS"), \"vocab\": $VOCAB, \"zipf\": $ZIPF, \"line_words\": $LINE_WORDS},"
+echo "  \"paths\": {\"file\": \"$PATHLIST\", \"bytes\": $(stat -c %s "$PATHLIST"), \"count\": $PATHS, \"depth\": $DEPTH, \"fanout\": $FANOUT},"
+echo "  \"threads\": $THREADS,"
+echo "  \"runs\": ["
+echo "[*] Running wordcount..." >&2
+emit wordcount "sort"             out.txt "$CORPUS"
+emit wordcount "hash"             --hash out.txt "$CORPUS"
+emit wordcount "mmap"             --mmap out.txt "$CORPUS"
+emit wordcount "threads"          --threads "$THREADS" out.txt "$CORPUS"
+emit wordcount "threads+reducers" --threads "$THREADS" --reducers "$THREADS" out.txt "$CORPUS"
+echo "[*] Running longest_path..." >&2
+emit longest_path "lines"   out.txt "$PATHLIST"
+emit longest_path "threads" --threads "$THREADS" out.txt "$PATHLIST"
+echo
+echo "  ]"
+echo "}"
+
+rm -f stats.json out.txt out.txt.part-*
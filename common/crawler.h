@@ -0,0 +1,191 @@
+#ifndef CRAWLER_H
+#define CRAWLER_H
+
+// Parallel directory walk, used as an input source in place of a file list
+// from find(1).
+//
+// Every root and everything below it is reported once, spelled the way
+// `find ROOT...` prints it (ROOT itself, then ROOT/name, ...). Symbolic
+// links are reported but not followed. Directories are read with
+// getdents64 into a per-thread buffer, and with fdopendir/readdir where the
+// syscall is not compiled in or fails with ENOSYS at run time.
+//
+// Each thread owns a deque of directories still to read: it pushes and
+// pops at the back (depth first, so recently listed directories are still
+// cached), and an idle thread steals from the front of another thread's
+// deque, which holds the oldest and usually largest subtrees.
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class DirectoryCrawler {
+public:
+    explicit DirectoryCrawler(unsigned threads) : queues_(threads == 0 ? 1 : threads) {}
+
+    // Calls on_path(thread, path) for every path under the roots, from
+    // `threads` threads; the view is only valid during the call. Returns
+    // the number of paths reported.
+    template <typename OnPath>
+    std::size_t crawl(const std::vector<std::string> &roots, OnPath &&on_path) {
+        const unsigned threads = static_cast<unsigned>(queues_.size());
+        std::vector<std::size_t> found(threads, 0);
+        for (const auto &root : roots) {
+            struct stat st;
+            if (::lstat(root.c_str(), &st) != 0) {
+                ++errors_;
+                continue;
+            }
+            on_path(0u, std::string_view(root));
+            ++found[0];
+            if (S_ISDIR(st.st_mode)) push(0, root);
+        }
+
+        auto worker = [&](unsigned t) {
+            std::vector<char> buf(kBufferSize);
+            std::string dir;
+            std::string path;
+            unsigned idle = 0;
+            while (pending_.load(std::memory_order_acquire) > 0) {
+                if (!pop(t, dir) && !steal(t, dir)) {
+                    if (++idle >= 64) std::this_thread::sleep_for(std::chrono::microseconds(50));
+                    else std::this_thread::yield();
+                    continue;
+                }
+                idle = 0;
+                path = dir;
+                if (path.back() != '/') path += '/';
+                const std::size_t base = path.size();
+                read_dir(dir, buf, [&](const char *name, bool is_dir) {
+                    path.resize(base);
+                    path += name;
+                    on_path(t, std::string_view(path));
+                    ++found[t];
+                    if (is_dir) push(t, path);
+                });
+                pending_.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker, t);
+        worker(0);
+        for (auto &th : pool) th.join();
+
+        std::size_t total = 0;
+        for (auto n : found) total += n;
+        return total;
+    }
+
+    // Roots and directories that could not be opened or read.
+    std::size_t errors() const { return errors_.load(); }
+
+private:
+    static constexpr std::size_t kBufferSize = 64 * 1024;
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::string> dirs;
+    };
+
+    void push(unsigned t, const std::string &dir) {
+        pending_.fetch_add(1, std::memory_order_acq_rel);
+        std::lock_guard<std::mutex> lock(queues_[t].mutex);
+        queues_[t].dirs.push_back(dir);
+    }
+
+    bool pop(unsigned t, std::string &dir) {
+        std::lock_guard<std::mutex> lock(queues_[t].mutex);
+        if (queues_[t].dirs.empty()) return false;
+        dir.swap(queues_[t].dirs.back());
+        queues_[t].dirs.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned t, std::string &dir) {
+        for (std::size_t i = 1; i < queues_.size(); ++i) {
+            Queue &q = queues_[(t + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.dirs.empty()) continue;
+            dir.swap(q.dirs.front());
+            q.dirs.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    // Calls entry(name, is_dir) for every entry of dir except . and ..
+    template <typename Entry>
+    void read_dir(const std::string &dir, std::vector<char> &buf, Entry &&entry) {
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            ++errors_;
+            return;
+        }
+        auto is_dir = [&](const char *name, unsigned char type) {
+            if (type != DT_UNKNOWN) return type == DT_DIR;
+            struct stat st;
+            return ::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        };
+        auto skip = [](const char *name) {
+            return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+        };
+#ifdef SYS_getdents64
+        // struct linux_dirent64: ino, off, reclen, type, name. A kernel or
+        // sandbox without the syscall (ENOSYS on the first call) switches
+        // every thread to readdir for the rest of the crawl.
+        for (bool first = true; !no_getdents_.load(std::memory_order_relaxed) || !first;
+             first = false) {
+            long n = ::syscall(SYS_getdents64, fd, buf.data(), buf.size());
+            if (n < 0 && first && errno == ENOSYS) {
+                no_getdents_.store(true, std::memory_order_relaxed);
+                break;
+            }
+            if (n < 0) ++errors_;
+            if (n <= 0) {
+                ::close(fd);
+                return;
+            }
+            for (long off = 0; off < n;) {
+                const char *rec = buf.data() + off;
+                unsigned short reclen;
+                std::memcpy(&reclen, rec + 16, sizeof(reclen));
+                unsigned char type = static_cast<unsigned char>(rec[18]);
+                const char *name = rec + 19;
+                if (!skip(name)) entry(name, is_dir(name, type));
+                off += reclen;
+            }
+        }
+#else
+        (void)buf;
+#endif
+        DIR *d = ::fdopendir(fd);
+        if (!d) {
+            ::close(fd);
+            ++errors_;
+            return;
+        }
+        while (struct dirent *e = ::readdir(d)) {
+            if (!skip(e->d_name)) entry(e->d_name, is_dir(e->d_name, e->d_type));
+        }
+        ::closedir(d);
+    }
+
+    std::vector<Queue> queues_;
+    std::atomic<std::size_t> pending_{0};
+    std::atomic<std::size_t> errors_{0};
+    std::atomic<bool> no_getdents_{false};
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef FILE_MAP_H
+#define FILE_MAP_H
+
+// Shared by the memory-mappable file formats (result_index.h and
+// path_store.h): a read-only mapping of a whole file with a bounds check
+// for its sections, and the header-last write that finishes such a file.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class ReadOnlyFile {
+public:
+    // Maps the file if it is at least min_size bytes long; ok() is false
+    // otherwise.
+    ReadOnlyFile(const std::string &path, std::size_t min_size) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(min_size) &&
+            st.st_size > 0) {
+            size_ = static_cast<std::size_t>(st.st_size);
+            void *p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) data_ = static_cast<const char *>(p);
+        }
+        ::close(fd);
+    }
+
+    ~ReadOnlyFile() { close(); }
+
+    ReadOnlyFile(const ReadOnlyFile &) = delete;
+    ReadOnlyFile &operator=(const ReadOnlyFile &) = delete;
+
+    bool ok() const { return data_ != nullptr; }
+    const char *data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+    // True if [offset, offset + bytes) lies inside the file.
+    bool fits(std::uint64_t offset, std::uint64_t bytes) const {
+        return offset <= size_ && bytes <= size_ - offset;
+    }
+
+    // Unmaps the file, e.g. after its header failed validation.
+    void close() {
+        if (data_) ::munmap(const_cast<char *>(data_), size_);
+        data_ = nullptr;
+    }
+
+private:
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// Writers reserve a zeroed header at offset 0 and stream the sections after
+// it. The real header goes in last, so a half-written file never looks
+// valid. Closes fp either way; false if any write failed.
+inline bool write_header_last(FILE *&fp, const void *header, std::size_t size) {
+    bool ok = std::fseek(fp, 0, SEEK_SET) == 0 && std::fwrite(header, size, 1, fp) == 1;
+    ok = std::fclose(fp) == 0 && ok;
+    fp = nullptr;
+    return ok;
+}
+
+#endif
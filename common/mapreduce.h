@@ -0,0 +1,368 @@
+#ifndef MAPREDUCE_H
+#define MAPREDUCE_H
+
+// Header-only MapReduce driver shared by the jobs in this repo.
+//
+// A job plugs in three types:
+//
+//   Mapper    copied once per worker thread.
+//             std::size_t align(const char *data, std::size_t size,
+//                               std::size_t pos) const;
+//                 first record boundary at or after pos (chunk cut points)
+//             std::size_t map(const char *begin, const char *end, Combiner &out);
+//                 maps one chunk or one line, returns the number of records
+//
+//   Combiner  default-constructible, movable per-worker map output.
+//
+//   Reducer   using Result = ...;
+//             Result reduce(std::vector<Combiner> &outputs,
+//                           unsigned r, unsigned partitions) const;
+//                 builds partition r out of every worker's output. Reducers
+//                 of different partitions run concurrently, so each must only
+//                 touch the entries of its own partition.
+//
+// MapReduceJob handles input (mmap with a line-by-line fallback, or the
+// staged reader of pipeline.h), splitting at record boundaries, the worker
+// pool, the partitioned reduce and phase timings.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+
+// Read-only mapping of a whole input file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ == 0) {
+                ok_ = true;
+            } else {
+                void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    ::madvise(p, size_, MADV_SEQUENTIAL);
+                    data_ = static_cast<const char *>(p);
+                    ok_ = true;
+                }
+            }
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char *>(data_), size_);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool ok() const { return ok_; }
+    const char *data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    std::size_t size_ = 0;
+    bool ok_ = false;
+};
+
+// Drops the mapped pages wholly inside [begin, end) from the page cache
+// mapping once they have been consumed, so a long scan under a memory limit
+// does not keep the whole input resident. Pages shared with a neighbouring
+// range are kept.
+inline void release_pages(const char *begin, const char *end) {
+    const std::uintptr_t page = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+    std::uintptr_t lo = (reinterpret_cast<std::uintptr_t>(begin) + page - 1) & ~(page - 1);
+    std::uintptr_t hi = reinterpret_cast<std::uintptr_t>(end) & ~(page - 1);
+    if (lo < hi) ::madvise(reinterpret_cast<void *>(lo), hi - lo, MADV_DONTNEED);
+}
+
+// Calls on_range(begin, end) once per mappable input and once per line
+// (without the newline) for inputs that cannot be mapped, e.g. pipes.
+// Returns the number of bytes seen.
+template <typename OnRange>
+std::size_t scan_files(const std::vector<std::string> &input_files, OnRange &&on_range) {
+    std::size_t bytes = 0;
+    for (const auto &input_file : input_files) {
+        MappedFile mf(input_file);
+        if (mf.ok()) {
+            on_range(mf.data(), mf.data() + mf.size());
+            bytes += mf.size();
+            continue;
+        }
+        std::ifstream in(input_file);
+        if (!in) {
+            std::cerr << "Error: cannot open input file: " << input_file << "\n";
+            continue;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            on_range(line.data(), line.data() + line.size());
+            bytes += line.size() + 1;
+        }
+    }
+    return bytes;
+}
+
+class Stopwatch {
+public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+struct JobStats {
+    std::size_t input_bytes = 0;
+    std::size_t records = 0;
+    unsigned threads = 1;
+    unsigned partitions = 1;
+    double map_seconds = 0;
+    double reduce_seconds = 0;
+    double write_seconds = 0;
+
+    void print(std::ostream &os) const {
+        auto rate = [](double amount, double secs) { return secs > 0 ? amount / secs : 0.0; };
+        char buf[256];
+        std::snprintf(buf, sizeof(buf),
+                      "[MapReduce] map %.3f s (%.1f MB/s, %.2f M records/s, %u threads), "
+                      "reduce %.3f s (%u partitions), write %.3f s\n",
+                      map_seconds, rate(input_bytes / 1e6, map_seconds),
+                      rate(records / 1e6, map_seconds), threads,
+                      reduce_seconds, partitions, write_seconds);
+        os << buf;
+    }
+
+    // One JSON object with the raw counters and per-phase rates, for
+    // benchmark scripts.
+    void print_json(std::ostream &os) const {
+        auto rate = [](double amount, double secs) { return secs > 0 ? amount / secs : 0.0; };
+        char buf[1024];
+        std::snprintf(buf, sizeof(buf),
+                      "{\"input_bytes\": %zu, \"records\": %zu, \"threads\": %u, "
+                      "\"partitions\": %u, "
+                      "\"map\": {\"seconds\": %.6f, \"mb_per_s\": %.3f, \"records_per_s\": %.1f}, "
+                      "\"reduce\": {\"seconds\": %.6f, \"mb_per_s\": %.3f, \"records_per_s\": %.1f}, "
+                      "\"write\": {\"seconds\": %.6f, \"mb_per_s\": %.3f, \"records_per_s\": %.1f}}\n",
+                      input_bytes, records, threads, partitions,
+                      map_seconds, rate(input_bytes / 1e6, map_seconds),
+                      rate(static_cast<double>(records), map_seconds),
+                      reduce_seconds, rate(input_bytes / 1e6, reduce_seconds),
+                      rate(static_cast<double>(records), reduce_seconds),
+                      write_seconds, rate(input_bytes / 1e6, write_seconds),
+                      rate(static_cast<double>(records), write_seconds));
+        os << buf;
+    }
+
+    // --stats prints the summary line, --stats-json FILE writes print_json.
+    bool report(bool show, const std::string &json_path) const {
+        if (show) print(std::cout);
+        if (json_path.empty()) return true;
+        std::ofstream out(json_path);
+        print_json(out);
+        if (!out) {
+            std::cerr << "Error: cannot write stats file: " << json_path << "\n";
+            return false;
+        }
+        return true;
+    }
+};
+
+struct JobOptions {
+    unsigned threads = 1;
+    unsigned partitions = 1;
+    bool use_mmap = false;         // split mapped inputs across the threads;
+                                   // otherwise each input is one range
+    std::size_t min_chunk = 1 << 20;
+    std::size_t max_chunk = 0;     // 0 = no limit
+    bool pipeline = false;         // reader thread + buffer pool (pipeline.h)
+    bool io_uring = true;          // pipeline reads via io_uring when available
+    unsigned io_buffers = 0;       // 0 = two per thread plus two
+    std::size_t io_block = 4 << 20;
+};
+
+template <typename Mapper, typename Combiner, typename Reducer>
+class MapReduceJob {
+public:
+    using Result = typename Reducer::Result;
+
+    explicit MapReduceJob(const JobOptions &opt, Mapper mapper = Mapper(),
+                          Reducer reducer = Reducer())
+        : opt_(opt), mapper_(std::move(mapper)), reducer_(std::move(reducer)) {
+        if (opt_.threads == 0) opt_.threads = 1;
+        if (opt_.partitions == 0) opt_.partitions = 1;
+        stats_.threads = opt_.threads;
+        stats_.partitions = opt_.partitions;
+    }
+
+    // Called on a worker's combiner after each chunk (or line) it maps, e.g.
+    // to spill it to disk once it grows too large.
+    void on_chunk(std::function<void(Combiner &)> hook) { hook_ = std::move(hook); }
+
+    // Maps every input and returns one combiner per worker.
+    std::vector<Combiner> map(const std::vector<std::string> &input_files) {
+        if (opt_.pipeline) return map_pipelined(input_files);
+        Stopwatch timer;
+        std::vector<Combiner> outputs(opt_.threads);
+        std::vector<std::size_t> records(opt_.threads, 0);
+
+        std::vector<std::unique_ptr<MappedFile>> files;
+        std::vector<std::pair<const char *, const char *>> chunks;
+        std::vector<std::string> streamed;
+        for (const auto &input_file : input_files) {
+            // A chunk limit or a per-chunk hook needs the inputs cut up even
+            // when they would otherwise be mapped whole.
+            std::unique_ptr<MappedFile> mf;
+            if (opt_.use_mmap || opt_.max_chunk > 0 || hook_) {
+                mf = std::make_unique<MappedFile>(input_file);
+            }
+            if (!mf || !mf->ok()) {
+                streamed.push_back(input_file);
+                continue;
+            }
+            split(mf->data(), mf->size(), chunks);
+            stats_.input_bytes += mf->size();
+            files.push_back(std::move(mf));
+        }
+
+        std::atomic<std::size_t> next{0};
+        auto worker = [&](unsigned t) {
+            Mapper mapper = mapper_;
+            std::size_t i;
+            while ((i = next.fetch_add(1)) < chunks.size()) {
+                records[t] += mapper.map(chunks[i].first, chunks[i].second, outputs[t]);
+                if (hook_) hook_(outputs[t]);
+                if (opt_.max_chunk > 0) release_pages(chunks[i].first, chunks[i].second);
+            }
+        };
+        if (opt_.threads == 1) {
+            worker(0);
+        } else {
+            std::vector<std::thread> pool;
+            for (unsigned t = 0; t < opt_.threads; ++t) pool.emplace_back(worker, t);
+            for (auto &th : pool) th.join();
+        }
+
+        // Pipes and devices cannot be mapped or split; they go through the
+        // first worker's combiner one line at a time.
+        Mapper mapper = mapper_;
+        stats_.input_bytes += scan_files(streamed, [&](const char *b, const char *e) {
+            records[0] += mapper.map(b, e, outputs[0]);
+            if (hook_) hook_(outputs[0]);
+        });
+
+        for (auto n : records) stats_.records += n;
+        stats_.map_seconds += timer.seconds();
+        return outputs;
+    }
+
+    // Reduces every partition, one thread per partition, and hands each
+    // result to sink(r, Result &&) on the reducer's own thread.
+    template <typename Sink>
+    void reduce(std::vector<Combiner> &outputs, Sink &&sink) {
+        Stopwatch timer;
+        const unsigned partitions = opt_.partitions;
+        if (partitions == 1) {
+            sink(0u, reducer_.reduce(outputs, 0, 1));
+        } else {
+            std::vector<std::thread> pool;
+            for (unsigned r = 0; r < partitions; ++r) {
+                pool.emplace_back([&, r] {
+                    sink(r, reducer_.reduce(outputs, r, partitions));
+                });
+            }
+            for (auto &th : pool) th.join();
+        }
+        stats_.reduce_seconds += timer.seconds();
+    }
+
+    JobStats &stats() { return stats_; }
+    const JobOptions &options() const { return opt_; }
+
+private:
+    // JobOptions::pipeline: this thread reads the inputs into pooled buffers
+    // while the workers map them as they arrive. Every queued range holds a
+    // buffer, so the work queue never fills before the pool runs dry.
+    std::vector<Combiner> map_pipelined(const std::vector<std::string> &input_files) {
+        Stopwatch timer;
+        std::vector<Combiner> outputs(opt_.threads);
+        std::vector<std::size_t> records(opt_.threads, 0);
+        const unsigned buffers = opt_.io_buffers > 0 ? opt_.io_buffers : 2 * opt_.threads + 2;
+        BufferPool pool(buffers, opt_.io_block, kPipelineSlack);
+        BoundedQueue<PipelineWork> work(buffers + opt_.threads);
+
+        auto worker = [&](unsigned t) {
+            Mapper mapper = mapper_;
+            for (;;) {
+                PipelineWork w = work.pop();
+                if (w.id == PipelineWork::kStop) return;
+                const char *data = pool.data(w.id);
+                records[t] += mapper.map(data + w.begin, data + w.end, outputs[t]);
+                if (hook_) hook_(outputs[t]);
+                pool.release(w.id);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < opt_.threads; ++t) workers.emplace_back(worker, t);
+
+        PipelineReader reader(pool, work, [this](const char *data, std::size_t size, std::size_t pos) {
+            return mapper_.align(data, size, pos);
+        }, opt_.io_uring);
+        for (const auto &input_file : input_files) stats_.input_bytes += reader.read_file(input_file);
+        for (unsigned t = 0; t < opt_.threads; ++t) work.push({PipelineWork::kStop, 0, 0});
+        for (auto &th : workers) th.join();
+
+        for (auto n : records) stats_.records += n;
+        stats_.map_seconds += timer.seconds();
+        return outputs;
+    }
+
+    // Cuts a mapped file into chunks at record boundaries. A few chunks per
+    // thread keep workers balanced across files of very different sizes.
+    void split(const char *data, std::size_t size,
+               std::vector<std::pair<const char *, const char *>> &chunks) const {
+        if (size == 0) return;
+        std::size_t parts = std::max<std::size_t>(
+            1, std::min<std::size_t>(opt_.threads * 4, size / opt_.min_chunk));
+        if (opt_.threads == 1) parts = 1;
+        if (opt_.max_chunk > 0) parts = std::max(parts, size / opt_.max_chunk + 1);
+
+        std::size_t step = (size + parts - 1) / parts;
+        std::size_t begin = 0;
+        while (begin < size) {
+            std::size_t end = std::min(size, begin + step);
+            end = end < size ? mapper_.align(data, size, end) : size;
+            chunks.push_back({data + begin, data + end});
+            begin = end;
+        }
+    }
+
+    JobOptions opt_;
+    Mapper mapper_;
+    Reducer reducer_;
+    std::function<void(Combiner &)> hook_;
+    JobStats stats_;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef MPI_SPLIT_H
+#define MPI_SPLIT_H
+
+// Input splitting shared by the MPI programs: the inputs are treated as one
+// byte stream cut evenly across ranks, and each rank moves its cut points
+// to record boundaries so every record is read by exactly one rank.
+
+#include <mpi.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+
+// Part of one input file scanned by this rank.
+struct FileRange {
+    std::string path;
+    std::size_t begin;
+    std::size_t end;
+};
+
+// Rank 0 decides the file sizes so every rank splits the same way. Inputs
+// that are not regular files count as empty.
+inline std::vector<unsigned long long> broadcast_file_sizes(const std::vector<std::string> &files,
+                                                            int rank) {
+    std::vector<unsigned long long> sizes(files.size(), 0);
+    if (rank == 0) {
+        for (std::size_t i = 0; i < files.size(); ++i) {
+            struct stat st;
+            if (::stat(files[i].c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                sizes[i] = static_cast<unsigned long long>(st.st_size);
+            } else {
+                std::cerr << "Error: cannot open input file: " << files[i] << "\n";
+            }
+        }
+    }
+    MPI_Bcast(sizes.data(), static_cast<int>(sizes.size()),
+              MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+    return sizes;
+}
+
+// Rank r gets bytes [r*T/n, (r+1)*T/n) of the concatenated inputs.
+inline std::vector<FileRange> assign_ranges(const std::vector<std::string> &files,
+                                            const std::vector<unsigned long long> &sizes,
+                                            int rank, int nranks) {
+    unsigned long long total = 0;
+    for (auto s : sizes) total += s;
+    unsigned long long lo = total * rank / nranks;
+    unsigned long long hi = total * (rank + 1) / nranks;
+
+    std::vector<FileRange> ranges;
+    unsigned long long offset = 0;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        unsigned long long fb = offset, fe = offset + sizes[i];
+        offset = fe;
+        if (fe <= lo || fb >= hi) continue;
+        ranges.push_back({files[i],
+                          static_cast<std::size_t>(std::max(fb, lo) - fb),
+                          static_cast<std::size_t>(std::min(fe, hi) - fb)});
+    }
+    return ranges;
+}
+
+// A rank owns every record whose first byte lies in its range: both cut
+// points move forward past the record they fall inside of, so the rank
+// skips the rest of a record started by the previous rank and finishes its
+// last record even if it runs past the range end. continues(c) is true if a
+// record goes on after byte c (a word byte, anything but '\n', ...).
+template <typename Continues>
+std::pair<std::size_t, std::size_t> align_range(const char *data, std::size_t size,
+                                                const FileRange &range, Continues &&continues) {
+    std::size_t b = std::min(range.begin, size);
+    std::size_t e = std::min(range.end, size);
+    while (b > 0 && b < size && continues(data[b - 1])) ++b;
+    while (e > 0 && e < size && continues(data[e - 1])) ++e;
+    return {b, std::max(b, e)};
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef PARALLEL_SORT_H
+#define PARALLEL_SORT_H
+
+// Sorting by string key for the reduce stages.
+//
+// msd_radix_sort is an in-place MSD radix sort (American flag sort) on the
+// key bytes; it never compares whole strings, only the byte at the current
+// depth, and falls back to insertion sort on small buckets. parallel_sort
+// splits the input into key ranges with sample-sort splitters and radix
+// sorts the ranges concurrently.
+//
+// Key is a callable returning a std::string_view for an element; the view
+// must stay valid while sorting. Equal keys end up adjacent in unspecified
+// order (none of these sorts is stable).
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace psort {
+
+constexpr std::size_t kInsertionThreshold = 32;
+constexpr std::size_t kParallelThreshold = 1 << 16;
+
+// 0 for "key ended", 1 + byte otherwise, so shorter keys sort first.
+inline unsigned byte_at(std::string_view s, std::size_t depth) {
+    return depth < s.size() ? static_cast<unsigned char>(s[depth]) + 1u : 0u;
+}
+
+// Elements of a[0, n) share their first `depth` key bytes.
+template <typename T, typename Key>
+void insertion_sort(T *a, std::size_t n, std::size_t depth, const Key &key) {
+    for (std::size_t i = 1; i < n; ++i) {
+        for (std::size_t j = i; j > 0; --j) {
+            std::string_view x = key(a[j]), y = key(a[j - 1]);
+            if (x.substr(std::min(depth, x.size())) >= y.substr(std::min(depth, y.size()))) break;
+            std::swap(a[j], a[j - 1]);
+        }
+    }
+}
+
+} // namespace psort
+
+// Buckets still to be sorted are kept on an explicit stack rather than
+// recursed into: keys with long shared prefixes (nested paths, "a", "aa",
+// "aaa", ...) would otherwise need one 6 KB frame per distinguishing byte.
+template <typename T, typename Key>
+void msd_radix_sort(T *a, std::size_t n, const Key &key, std::size_t depth = 0) {
+    using psort::byte_at;
+    struct Range {
+        T *a;
+        std::size_t n;
+        std::size_t depth;
+    };
+    std::vector<Range> pending{{a, n, depth}};
+    while (!pending.empty()) {
+        Range r = pending.back();
+        pending.pop_back();
+        a = r.a;
+        n = r.n;
+        depth = r.depth;
+        if (n < psort::kInsertionThreshold) {
+            psort::insertion_sort(a, n, depth, key);
+            continue;
+        }
+        std::size_t count[257] = {0};
+        for (std::size_t i = 0; i < n; ++i) ++count[byte_at(key(a[i]), depth)];
+
+        // A byte shared by every key (common prefix) needs no pass.
+        unsigned only = 257;
+        for (unsigned b = 0; b < 257; ++b) {
+            if (count[b] == n) only = b;
+        }
+        if (only == 0) continue;  // all keys equal
+        if (only < 257) {
+            pending.push_back({a, n, depth + 1});
+            continue;
+        }
+
+        std::size_t next[257], end[257];
+        std::size_t pos = 0;
+        for (unsigned b = 0; b < 257; ++b) {
+            next[b] = pos;
+            pos += count[b];
+            end[b] = pos;
+        }
+        // Cycle every element into its bucket, swapping in place.
+        for (unsigned b = 0; b < 257; ++b) {
+            while (next[b] < end[b]) {
+                unsigned v = byte_at(key(a[next[b]]), depth);
+                while (v != b) {
+                    std::swap(a[next[b]], a[next[v]++]);
+                    v = byte_at(key(a[next[b]]), depth);
+                }
+                ++next[b];
+            }
+        }
+        // Bucket 0 holds keys that ended here, all equal.
+        for (unsigned b = 1; b < 257; ++b) {
+            std::size_t begin = end[b] - count[b];
+            if (count[b] > 1) pending.push_back({a + begin, count[b], depth + 1});
+        }
+    }
+}
+
+template <typename T, typename Key>
+void msd_radix_sort(std::vector<T> &v, const Key &key) {
+    msd_radix_sort(v.data(), v.size(), key, 0);
+}
+
+// Sample sort on top of msd_radix_sort: splitters taken from a sorted
+// sample cut the keys into ranges, elements are scattered by range into a
+// scratch array in parallel, and the ranges are radix sorted concurrently.
+template <typename T, typename Key>
+void parallel_sort(std::vector<T> &v, const Key &key, unsigned threads) {
+    const std::size_t n = v.size();
+    if (threads <= 1 || n < psort::kParallelThreshold) {
+        msd_radix_sort(v, key);
+        return;
+    }
+
+    // A few ranges per thread keep the threads busy when ranges are uneven.
+    const std::size_t ranges = static_cast<std::size_t>(threads) * 4;
+    const std::size_t oversample = 32;
+    std::vector<std::string_view> sample;
+    sample.reserve(ranges * oversample);
+    for (std::size_t i = 0; i < ranges * oversample; ++i) {
+        sample.push_back(key(v[i * n / (ranges * oversample)]));
+    }
+    std::sort(sample.begin(), sample.end());
+    std::vector<std::string_view> splitters;
+    for (std::size_t r = 1; r < ranges; ++r) {
+        std::string_view s = sample[r * oversample];
+        if (splitters.empty() || splitters.back() != s) splitters.push_back(s);
+    }
+    const std::size_t buckets = splitters.size() + 1;
+
+    auto run = [threads](auto &&task) {
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t) pool.emplace_back(task, t);
+        for (auto &th : pool) th.join();
+    };
+
+    // Classify: bucket of every element, counted per thread block.
+    std::vector<std::uint32_t> bucket_of(n);
+    std::vector<std::size_t> counts(static_cast<std::size_t>(threads) * buckets, 0);
+    auto block = [&](unsigned t) { return std::make_pair(n * t / threads, n * (t + 1) / threads); };
+    run([&](unsigned t) {
+        auto [lo, hi] = block(t);
+        std::size_t *c = &counts[t * buckets];
+        for (std::size_t i = lo; i < hi; ++i) {
+            auto it = std::upper_bound(splitters.begin(), splitters.end(), key(v[i]));
+            bucket_of[i] = static_cast<std::uint32_t>(it - splitters.begin());
+            ++c[bucket_of[i]];
+        }
+    });
+
+    // Bucket-major offsets, so each bucket is contiguous in the scratch array.
+    std::vector<std::size_t> bucket_begin(buckets + 1, 0);
+    std::size_t pos = 0;
+    for (std::size_t b = 0; b < buckets; ++b) {
+        bucket_begin[b] = pos;
+        for (unsigned t = 0; t < threads; ++t) {
+            std::size_t c = counts[t * buckets + b];
+            counts[t * buckets + b] = pos;
+            pos += c;
+        }
+    }
+    bucket_begin[buckets] = pos;
+
+    std::vector<T> scratch(n);
+    run([&](unsigned t) {
+        auto [lo, hi] = block(t);
+        std::size_t *offset = &counts[t * buckets];
+        for (std::size_t i = lo; i < hi; ++i) scratch[offset[bucket_of[i]]++] = std::move(v[i]);
+    });
+
+    std::atomic<std::size_t> next{0};
+    run([&](unsigned) {
+        std::size_t b;
+        while ((b = next.fetch_add(1)) < buckets) {
+            std::size_t lo = bucket_begin[b], hi = bucket_begin[b + 1];
+            msd_radix_sort(scratch.data() + lo, hi - lo, key, 0);
+            std::move(scratch.begin() + lo, scratch.begin() + hi, v.begin() + lo);
+        }
+    });
+}
+
+#endif
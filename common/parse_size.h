@@ -0,0 +1,25 @@
+#ifndef PARSE_SIZE_H
+#define PARSE_SIZE_H
+
+// Byte-size arguments for the command-line tools (wordcount --memory-budget,
+// gen_corpus --size).
+
+#include <cstdlib>
+
+// Parses a byte count with an optional K, M or G suffix (binary units), e.g.
+// "512M", "2G", "65536". Returns 0 on error.
+inline std::size_t parse_size(const char *text) {
+    char *end = nullptr;
+    double v = std::strtod(text, &end);
+    if (end == text || v <= 0) return 0;
+    switch (*end) {
+    case 'k': case 'K': v *= 1024.0; ++end; break;
+    case 'm': case 'M': v *= 1024.0 * 1024.0; ++end; break;
+    case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; ++end; break;
+    default: break;
+    }
+    if (*end != '\0') return 0;
+    return static_cast<std::size_t>(v);
+}
+
+#endif
@@ -0,0 +1,473 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Staged input for MapReduceJob (JobOptions::pipeline):
+//
+//   reader thread --(work queue)--> mapper threads --(free queue)--> reader
+//
+// The reader fills fixed-size buffers from a BufferPool, cuts each at the
+// last record boundary it can find near the end (carrying the cut-off tail
+// into the front of the next buffer), and queues the record-aligned range.
+// Mappers fold ranges into their own combiners and hand the buffer back.
+// The pool is the only memory the input uses, and an empty free queue is
+// what stops the reader when the mappers fall behind.
+//
+// Regular files are read ahead with io_uring when the kernel allows it
+// (raw syscalls, no liburing needed), otherwise with pread on the reader
+// thread; either way reading overlaps with mapping. Pipes and devices are
+// read sequentially with read(2).
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define PIPELINE_HAVE_IO_URING 1
+#endif
+
+// Bounded multi-producer/multi-consumer queue (Vyukov): each slot carries a
+// sequence number that tells producers and consumers whose turn it is, so
+// push and pop are a CAS on the position plus one store, with no locks.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity) {
+        std::size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        slots_ = std::make_unique<Slot[]>(cap);
+        mask_ = cap - 1;
+        for (std::size_t i = 0; i < cap; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool try_push(const T &value) {
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &s = slots_[pos & mask_];
+            std::size_t seq = s.seq.load(std::memory_order_acquire);
+            std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.value = value;
+                    s.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T &value) {
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &s = slots_[pos & mask_];
+            std::size_t seq = s.seq.load(std::memory_order_acquire);
+            std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = s.value;
+                    s.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Blocking variants: spin briefly, then yield the CPU between attempts.
+    void push(const T &value) {
+        for (unsigned spins = 0; !try_push(value); ++spins) backoff(spins);
+    }
+    T pop() {
+        T value;
+        for (unsigned spins = 0; !try_pop(value); ++spins) backoff(spins);
+        return value;
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> seq;
+        T value;
+    };
+
+    static void backoff(unsigned spins) {
+        if (spins >= 1024) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        } else if (spins >= 64) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t mask_ = 0;
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+// Fixed set of reusable input buffers. Each buffer has `slack` bytes in
+// front of its `block` bytes for the tail carried over from the previous
+// block.
+class BufferPool {
+public:
+    BufferPool(std::size_t count, std::size_t block, std::size_t slack)
+        : block_(block), slack_(slack), free_(count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            buffers_.emplace_back(new char[slack + block]);
+            free_.push(static_cast<std::uint32_t>(i));
+        }
+    }
+
+    std::uint32_t acquire() { return free_.pop(); }
+    bool try_acquire(std::uint32_t &id) { return free_.try_pop(id); }
+    void release(std::uint32_t id) { free_.push(id); }
+
+    char *data(std::uint32_t id) { return buffers_[id].get(); }
+    std::size_t block() const { return block_; }
+    std::size_t slack() const { return slack_; }
+    std::size_t count() const { return buffers_.size(); }
+
+private:
+    std::size_t block_;
+    std::size_t slack_;
+    std::vector<std::unique_ptr<char[]>> buffers_;
+    BoundedQueue<std::uint32_t> free_;
+};
+
+// Room in front of each buffer for the previous block's tail.
+constexpr std::size_t kPipelineSlack = 256 << 10;
+
+// A record-aligned range [begin, end) of buffer `id`; id kStop ends a mapper.
+struct PipelineWork {
+    static constexpr std::uint32_t kStop = 0xFFFFFFFFu;
+    std::uint32_t id;
+    std::uint32_t begin;
+    std::uint32_t end;
+};
+
+#ifdef PIPELINE_HAVE_IO_URING
+// Just enough io_uring for positional reads: one submission and one
+// completion ring, mapped from the kernel.
+class IoUring {
+public:
+    explicit IoUring(unsigned entries) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+        if (fd_ < 0) return;
+
+        sq_size_ = p.sq_off.array + p.sq_entries * sizeof(std::uint32_t);
+        cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        sq_ring_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd_, IORING_OFF_SQ_RING);
+        cq_ring_ = (p.features & IORING_FEAT_SINGLE_MMAP)
+            ? sq_ring_
+            : ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd_, IORING_OFF_CQ_RING);
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd_, IORING_OFF_SQES);
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+            if (sqes != MAP_FAILED) ::munmap(sqes, sqes_size_);
+            unmap_rings();
+            ::close(fd_);
+            fd_ = -1;
+            return;
+        }
+        char *sq = static_cast<char *>(sq_ring_);
+        char *cq = static_cast<char *>(cq_ring_);
+        sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+        sqes_ = static_cast<io_uring_sqe *>(sqes);
+    }
+
+    ~IoUring() {
+        if (fd_ < 0) return;
+        ::munmap(sqes_, sqes_size_);
+        unmap_rings();
+        ::close(fd_);
+    }
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+
+    // Queues and submits one read. The caller keeps the number in flight
+    // within the ring size. On false the entry has been taken back out of
+    // the ring, so it can never be submitted later into a buffer the caller
+    // has since reused.
+    bool read(int fd, void *buf, unsigned len, std::uint64_t offset, std::uint64_t tag) {
+        unsigned tail = *sq_tail_;
+        unsigned idx = tail & sq_mask_;
+        io_uring_sqe &sqe = sqes_[idx];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buf);
+        sqe.len = len;
+        sqe.off = offset;
+        sqe.user_data = tag;
+        sq_array_[idx] = idx;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        for (;;) {
+            long r = ::syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0);
+            if (r >= 0) return true;
+            if (errno != EINTR && errno != EAGAIN) break;
+        }
+        // A failed enter consumed nothing unless the kernel's head moved past
+        // the entry, in which case the read is in flight after all.
+        if (__atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) != tail) return true;
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    // Waits for one completion; res is the byte count or -errno.
+    bool wait(std::uint64_t &tag, int &res) {
+        for (;;) {
+            unsigned head = *cq_head_;
+            if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                tag = cqe.user_data;
+                res = cqe.res;
+                __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            long r = ::syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (r < 0 && errno != EINTR) return false;
+        }
+    }
+
+private:
+    void unmap_rings() {
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_size_);
+        if (sq_ring_ != MAP_FAILED) ::munmap(sq_ring_, sq_size_);
+    }
+
+    int fd_ = -1;
+    void *sq_ring_ = MAP_FAILED;
+    void *cq_ring_ = MAP_FAILED;
+    std::size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+    unsigned *sq_head_ = nullptr, *sq_tail_ = nullptr, *sq_array_ = nullptr, sq_mask_ = 0;
+    unsigned *cq_head_ = nullptr, *cq_tail_ = nullptr, cq_mask_ = 0;
+    io_uring_cqe *cqes_ = nullptr;
+    io_uring_sqe *sqes_ = nullptr;
+};
+#endif
+
+// The I/O stage. Align has the Mapper::align signature and picks the cut
+// points; a record longer than the pool's slack can be split at a buffer
+// edge.
+class PipelineReader {
+public:
+    using Align = std::function<std::size_t(const char *, std::size_t, std::size_t)>;
+
+    PipelineReader(BufferPool &pool, BoundedQueue<PipelineWork> &work, Align align,
+                   bool use_io_uring)
+        : pool_(pool), work_(work), align_(std::move(align)) {
+#ifdef PIPELINE_HAVE_IO_URING
+        if (use_io_uring) {
+            ring_ = std::make_unique<IoUring>(static_cast<unsigned>(pool.count()));
+            if (!ring_->ok()) ring_.reset();
+        }
+#else
+        (void)use_io_uring;
+#endif
+    }
+
+    bool using_io_uring() const {
+#ifdef PIPELINE_HAVE_IO_URING
+        return ring_ != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    // Reads one input and queues its ranges. Returns the bytes read.
+    std::size_t read_file(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::fprintf(stderr, "Error: cannot open input file: %s\n", path.c_str());
+            return 0;
+        }
+        struct stat st;
+        std::size_t bytes = 0;
+        carry_.clear();
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            bytes = read_regular(fd, static_cast<std::size_t>(st.st_size));
+        } else {
+            bytes = read_stream(fd);
+        }
+        ::close(fd);
+        return bytes;
+    }
+
+private:
+    struct Pending {
+        std::uint32_t id;
+        std::size_t len;
+        bool done;
+    };
+
+    // Blocks are read ahead (up to one per free buffer) and queued in file
+    // order as they complete.
+    std::size_t read_regular(int fd, std::size_t size) {
+        const std::size_t block = pool_.block();
+        const std::size_t blocks = (size + block - 1) / block;
+        std::deque<Pending> pending;  // block `first + i` is pending[i]
+        std::size_t first = 0, next = 0;
+
+        while (first < blocks) {
+            std::uint32_t id;
+            while (next < blocks && pending.size() < pool_.count() &&
+                   (pending.empty() ? (id = pool_.acquire(), true) : pool_.try_acquire(id))) {
+                std::size_t len = std::min(block, size - next * block);
+                pending.push_back({id, len, false});
+                submit(fd, id, len, next * block, next);
+                ++next;
+            }
+            std::uint64_t tag;
+            std::size_t got = complete(tag);
+            Pending &p = pending[tag - first];
+            if (got < p.len) {
+                // Short or failed asynchronous read: finish it synchronously.
+                char *data = pool_.data(p.id) + pool_.slack();
+                got += pread_full(fd, data + got, p.len - got, tag * block + got);
+            }
+            p.len = got;
+            p.done = true;
+            while (!pending.empty() && pending.front().done) {
+                ++first;
+                dispatch(pending.front().id, pending.front().len, first == blocks);
+                pending.pop_front();
+            }
+        }
+        return size;
+    }
+
+    std::size_t read_stream(int fd) {
+        std::size_t bytes = 0;
+        for (;;) {
+            std::uint32_t id = pool_.acquire();
+            char *data = pool_.data(id) + pool_.slack();
+            std::size_t len = 0;
+            while (len < pool_.block()) {
+                ssize_t n = ::read(fd, data + len, pool_.block() - len);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                len += static_cast<std::size_t>(n);
+            }
+            bytes += len;
+            bool last = len < pool_.block();
+            dispatch(id, len, last);
+            if (last) return bytes;
+        }
+    }
+
+    void submit(int fd, std::uint32_t id, std::size_t len, std::size_t offset, std::uint64_t tag) {
+        char *data = pool_.data(id) + pool_.slack();
+#ifdef PIPELINE_HAVE_IO_URING
+        if (ring_ && ring_->read(fd, data, static_cast<unsigned>(len), offset, tag)) return;
+#endif
+        done_.push_back({tag, pread_full(fd, data, len, offset)});
+    }
+
+    // Tag and byte count of the next finished read.
+    std::size_t complete(std::uint64_t &tag) {
+        if (!done_.empty()) {
+            tag = done_.front().first;
+            std::size_t len = done_.front().second;
+            done_.pop_front();
+            return len;
+        }
+#ifdef PIPELINE_HAVE_IO_URING
+        int res = -1;
+        if (!ring_->wait(tag, res)) {
+            // The kernel still owns the buffers in flight; nothing safe to do.
+            std::perror("Error: io_uring wait failed");
+            std::abort();
+        }
+        if (res > 0) return static_cast<std::size_t>(res);
+#endif
+        return 0;
+    }
+
+    std::size_t pread_full(int fd, char *buf, std::size_t len, std::size_t offset) {
+        std::size_t got = 0;
+        while (got < len) {
+            ssize_t n = ::pread(fd, buf + got, len - got, static_cast<off_t>(offset + got));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += static_cast<std::size_t>(n);
+        }
+        return got;
+    }
+
+    // Puts the carried tail in front of the block, cuts the block at a
+    // record boundary near its end, keeps what follows for the next block
+    // and queues the rest.
+    void dispatch(std::uint32_t id, std::size_t len, bool last) {
+        char *base = pool_.data(id);
+        const std::size_t slack = pool_.slack();
+        std::size_t begin = slack - carry_.size();
+        std::memcpy(base + begin, carry_.data(), carry_.size());
+        const std::size_t end = slack + len;
+
+        std::size_t cut = end;
+        if (!last) {
+            for (std::size_t step : {std::size_t(256), std::size_t(4096), slack}) {
+                std::size_t from = end - std::min(step, end - begin);
+                std::size_t b = align_(base, end, from);
+                if (b < end) {
+                    cut = b;
+                    break;
+                }
+            }
+        }
+        carry_.assign(base + cut, end - cut);
+        if (cut > begin) {
+            work_.push({id, static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(cut)});
+        } else {
+            pool_.release(id);
+        }
+    }
+
+    BufferPool &pool_;
+    BoundedQueue<PipelineWork> &work_;
+    Align align_;
+    std::string carry_;
+    std::deque<std::pair<std::uint64_t, std::size_t>> done_;
+#ifdef PIPELINE_HAVE_IO_URING
+    std::unique_ptr<IoUring> ring_;
+#endif
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef RESULT_INDEX_H
+#define RESULT_INDEX_H
+
+// Binary, memory-mappable index over a key -> count result.
+//
+// Layout (native endianness, sections 8-byte aligned):
+//   Header     magic "WCINDEX1", counts and section offsets
+//   keys       all keys concatenated, in sorted order
+//   offsets    uint64[count + 1], key i is keys[offsets[i], offsets[i+1])
+//   counts     int64[count]
+//   disp       uint32[buckets], displacement per hash bucket
+//   slots      uint32[count], MPH slot -> key rank
+//
+// The minimal perfect hash is hash-and-displace: a key with hash h falls
+// into bucket (h >> 32) % buckets and lands in slot
+// mix(h ^ disp[bucket] * K) % count. The builder picks the displacements,
+// largest bucket first, so every key gets its own slot. A point lookup is
+// one hash, two table reads and one key compare; a prefix query is a binary
+// search over the sorted keys. Opening an index only maps the file and
+// checks the header.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_map.h"
+#include "string_arena.h"
+
+namespace result_index {
+
+struct Header {
+    char magic[8];
+    std::uint64_t count;
+    std::uint64_t buckets;
+    std::uint64_t keys_offset;
+    std::uint64_t keys_size;
+    std::uint64_t offsets_offset;
+    std::uint64_t counts_offset;
+    std::uint64_t disp_offset;
+    std::uint64_t slots_offset;
+};
+
+constexpr char kMagic[8] = {'W', 'C', 'I', 'N', 'D', 'E', 'X', '1'};
+constexpr std::uint64_t kDispMultiplier = 0x9E3779B97F4A7C15ULL;
+constexpr std::size_t kKeysPerBucket = 4;
+
+// splitmix64 finalizer; spreads the displaced hash over all bits.
+inline std::uint64_t mix(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline std::uint64_t bucket_of(std::uint64_t h, std::uint64_t buckets) {
+    return (h >> 32) % buckets;
+}
+
+inline std::uint64_t slot_of(std::uint64_t h, std::uint32_t disp, std::uint64_t count) {
+    return mix(h ^ (disp * kDispMultiplier)) % count;
+}
+
+inline std::uint64_t align8(std::uint64_t x) { return (x + 7) & ~std::uint64_t(7); }
+
+} // namespace result_index
+
+// Builds an index from keys added in strictly increasing order. Keys are
+// streamed to the file; offsets, counts and hashes stay in memory (24 bytes
+// per key) until finish().
+class ResultIndexWriter {
+public:
+    ResultIndexWriter() = default;
+    ~ResultIndexWriter() {
+        if (fp_) std::fclose(fp_);
+    }
+    ResultIndexWriter(const ResultIndexWriter &) = delete;
+    ResultIndexWriter &operator=(const ResultIndexWriter &) = delete;
+
+    bool open(const std::string &path) {
+        fp_ = std::fopen(path.c_str(), "wb");
+        if (!fp_) return fail("cannot open index file: " + path);
+        std::setvbuf(fp_, nullptr, _IOFBF, 1 << 20);
+        result_index::Header header{};
+        std::fwrite(&header, sizeof(header), 1, fp_);
+        offsets_.push_back(0);
+        return true;
+    }
+
+    bool add(std::string_view key, long long count) {
+        if (!error_.empty()) return false;
+        if (!counts_.empty() && key <= std::string_view(last_)) {
+            return fail("keys must be added in strictly increasing order");
+        }
+        if (counts_.size() == 0xFFFFFFFFu) return fail("too many keys for one index");
+        std::fwrite(key.data(), 1, key.size(), fp_);
+        offsets_.push_back(offsets_.back() + key.size());
+        counts_.push_back(count);
+        hashes_.push_back(fnv1a(key));
+        last_.assign(key.data(), key.size());
+        return true;
+    }
+
+    bool finish() {
+        using namespace result_index;
+        if (!error_.empty()) return false;
+        const std::uint64_t n = counts_.size();
+        Header header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.count = n;
+        header.buckets = n / kKeysPerBucket + 1;
+        header.keys_offset = sizeof(Header);
+        header.keys_size = offsets_.back();
+
+        std::vector<std::uint32_t> disp, slots;
+        if (!build_mph(header.buckets, disp, slots)) return false;
+
+        std::uint64_t pos = header.keys_offset + header.keys_size;
+        auto section = [&](std::uint64_t bytes) {
+            static const char zeros[8] = {0};
+            std::uint64_t at = align8(pos);
+            std::fwrite(zeros, 1, at - pos, fp_);
+            pos = at + bytes;
+            return at;
+        };
+        header.offsets_offset = section(offsets_.size() * sizeof(std::uint64_t));
+        std::fwrite(offsets_.data(), sizeof(std::uint64_t), offsets_.size(), fp_);
+        header.counts_offset = section(n * sizeof(std::int64_t));
+        std::fwrite(counts_.data(), sizeof(std::int64_t), n, fp_);
+        header.disp_offset = section(disp.size() * sizeof(std::uint32_t));
+        std::fwrite(disp.data(), sizeof(std::uint32_t), disp.size(), fp_);
+        header.slots_offset = section(n * sizeof(std::uint32_t));
+        std::fwrite(slots.data(), sizeof(std::uint32_t), n, fp_);
+
+        return write_header_last(fp_, &header, sizeof(header)) || fail("cannot write index file");
+    }
+
+    std::size_t size() const { return counts_.size(); }
+    const std::string &error() const { return error_; }
+
+private:
+    bool fail(const std::string &message) {
+        if (error_.empty()) error_ = message;
+        return false;
+    }
+
+    bool build_mph(std::uint64_t buckets, std::vector<std::uint32_t> &disp,
+                   std::vector<std::uint32_t> &slots) {
+        using namespace result_index;
+        const std::uint64_t n = counts_.size();
+        disp.assign(buckets, 0);
+        slots.assign(n, 0);
+        if (n == 0) return true;
+
+        // Key ranks grouped by bucket (counting sort).
+        std::vector<std::uint32_t> begin(buckets + 1, 0), members(n);
+        for (std::uint64_t h : hashes_) ++begin[bucket_of(h, buckets) + 1];
+        for (std::uint64_t b = 0; b < buckets; ++b) begin[b + 1] += begin[b];
+        std::vector<std::uint32_t> fill(begin.begin(), begin.end() - 1);
+        for (std::uint32_t i = 0; i < n; ++i) members[fill[bucket_of(hashes_[i], buckets)]++] = i;
+
+        std::vector<std::uint32_t> order(buckets);
+        for (std::uint32_t b = 0; b < buckets; ++b) order[b] = b;
+        std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return begin[a + 1] - begin[a] > begin[b + 1] - begin[b];
+        });
+
+        std::vector<bool> taken(n, false);
+        std::vector<std::uint64_t> placed;
+        for (std::uint32_t b : order) {
+            std::uint32_t lo = begin[b], hi = begin[b + 1];
+            if (lo == hi) break;  // buckets are ordered by size
+            for (std::uint64_t d = 0;; ++d) {
+                if (d > 0xFFFFFFFFu) return fail("cannot build perfect hash (duplicate key hashes?)");
+                placed.clear();
+                bool fits = true;
+                for (std::uint32_t m = lo; m < hi && fits; ++m) {
+                    std::uint64_t s = slot_of(hashes_[members[m]], static_cast<std::uint32_t>(d), n);
+                    if (taken[s] || std::find(placed.begin(), placed.end(), s) != placed.end()) {
+                        fits = false;
+                    }
+                    placed.push_back(s);
+                }
+                if (!fits) continue;
+                disp[b] = static_cast<std::uint32_t>(d);
+                for (std::uint32_t m = lo; m < hi; ++m) {
+                    taken[placed[m - lo]] = true;
+                    slots[placed[m - lo]] = members[m];
+                }
+                break;
+            }
+        }
+        return true;
+    }
+
+    FILE *fp_ = nullptr;
+    std::vector<std::uint64_t> offsets_;
+    std::vector<std::int64_t> counts_;
+    std::vector<std::uint64_t> hashes_;
+    std::string last_;
+    std::string error_;
+};
+
+// Read-only view of an index file.
+class ResultIndex {
+public:
+    static constexpr std::uint64_t kNotFound = ~std::uint64_t(0);
+
+    explicit ResultIndex(const std::string &path)
+        : file_(path, sizeof(result_index::Header)) {
+        if (file_.ok() && !attach()) file_.close();
+    }
+
+    ResultIndex(const ResultIndex &) = delete;
+    ResultIndex &operator=(const ResultIndex &) = delete;
+
+    bool ok() const { return file_.ok(); }
+    std::uint64_t size() const { return header_.count; }
+
+    std::string_view key(std::uint64_t rank) const {
+        return std::string_view(keys_ + offsets_[rank], offsets_[rank + 1] - offsets_[rank]);
+    }
+    long long count(std::uint64_t rank) const { return counts_[rank]; }
+
+    // Rank of `key` in sorted order, or kNotFound.
+    std::uint64_t find(std::string_view key) const {
+        using namespace result_index;
+        const std::uint64_t n = header_.count;
+        if (n == 0) return kNotFound;
+        std::uint64_t h = fnv1a(key);
+        std::uint64_t s = slot_of(h, disp_[bucket_of(h, header_.buckets)], n);
+        std::uint64_t rank = slots_[s];
+        return this->key(rank) == key ? rank : kNotFound;
+    }
+
+    // Ranks [first, last) of the keys starting with `prefix`.
+    std::pair<std::uint64_t, std::uint64_t> prefix_range(std::string_view prefix) const {
+        std::uint64_t lo = 0, hi = header_.count;
+        while (lo < hi) {
+            std::uint64_t mid = lo + (hi - lo) / 2;
+            if (key(mid) < prefix) lo = mid + 1; else hi = mid;
+        }
+        std::uint64_t first = lo;
+        hi = header_.count;
+        while (lo < hi) {
+            std::uint64_t mid = lo + (hi - lo) / 2;
+            if (key(mid).substr(0, prefix.size()) == prefix) lo = mid + 1; else hi = mid;
+        }
+        return {first, lo};
+    }
+
+private:
+    // Validates the header and section bounds against the file size.
+    bool attach() {
+        using namespace result_index;
+        const char *base = file_.data();
+        std::memcpy(&header_, base, sizeof(header_));
+        if (std::memcmp(header_.magic, kMagic, sizeof(kMagic)) != 0 || header_.buckets == 0 ||
+            header_.count > file_.size() || header_.buckets > file_.size()) {
+            return false;
+        }
+        const std::uint64_t n = header_.count;
+        auto fits = [&](std::uint64_t offset, std::uint64_t bytes) {
+            return file_.fits(offset, bytes);
+        };
+        if (!fits(header_.keys_offset, header_.keys_size) ||
+            !fits(header_.offsets_offset, (n + 1) * sizeof(std::uint64_t)) ||
+            !fits(header_.counts_offset, n * sizeof(std::int64_t)) ||
+            !fits(header_.disp_offset, header_.buckets * sizeof(std::uint32_t)) ||
+            !fits(header_.slots_offset, n * sizeof(std::uint32_t))) {
+            return false;
+        }
+        keys_ = base + header_.keys_offset;
+        offsets_ = reinterpret_cast<const std::uint64_t *>(base + header_.offsets_offset);
+        counts_ = reinterpret_cast<const std::int64_t *>(base + header_.counts_offset);
+        disp_ = reinterpret_cast<const std::uint32_t *>(base + header_.disp_offset);
+        slots_ = reinterpret_cast<const std::uint32_t *>(base + header_.slots_offset);
+        return true;
+    }
+
+    ReadOnlyFile file_;
+    result_index::Header header_{};
+    const char *keys_ = nullptr;
+    const std::uint64_t *offsets_ = nullptr;
+    const std::int64_t *counts_ = nullptr;
+    const std::uint32_t *disp_ = nullptr;
+    const std::uint32_t *slots_ = nullptr;
+};
+
+#endif
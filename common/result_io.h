@@ -0,0 +1,191 @@
+#ifndef RESULT_IO_H
+#define RESULT_IO_H
+
+// Output stage for MapReduce results.
+//
+// ResultWriter formats records into one large reusable buffer (integers via
+// std::to_chars) and hands full buffers to write(2). A value too large for
+// the buffer goes out together with the buffered bytes in a single
+// writev(2). Each writer owns its file and buffer, so partitions can be
+// written from their own threads.
+//
+// Record formats:
+//   Text    "<key> <count>\n", as the jobs have always written
+//   Binary  varint key length, key bytes, varint count (unsigned LEB128)
+
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+enum class ResultFormat { Text, Binary };
+
+class ResultWriter {
+public:
+    static constexpr std::size_t kBufferSize = 1 << 20;
+
+    explicit ResultWriter(ResultFormat format = ResultFormat::Text,
+                          std::size_t buffer_size = kBufferSize)
+        : format_(format), buf_(buffer_size) {}
+
+    ~ResultWriter() { close(); }
+
+    ResultWriter(const ResultWriter &) = delete;
+    ResultWriter &operator=(const ResultWriter &) = delete;
+
+    bool open(const std::string &path) {
+        close();
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        failed_ = fd_ < 0;
+        if (failed_) std::cerr << "Error: cannot open output file: " << path << "\n";
+        return !failed_;
+    }
+
+    bool ok() const { return fd_ >= 0 && !failed_; }
+
+    // One key/count record in the writer's format.
+    void record(std::string_view key, long long value) {
+        if (format_ == ResultFormat::Text) {
+            append(key);
+            put(' ');
+            append_int(value);
+            put('\n');
+        } else {
+            append_varint(key.size());
+            append(key);
+            append_varint(static_cast<unsigned long long>(value));
+        }
+    }
+
+    void put(char c) {
+        if (used_ == buf_.size()) flush();
+        buf_[used_++] = c;
+    }
+
+    void append(std::string_view bytes) {
+        if (bytes.size() <= buf_.size() - used_) {
+            bytes.copy(buf_.data() + used_, bytes.size());
+            used_ += bytes.size();
+            return;
+        }
+        if (bytes.size() < buf_.size()) {
+            flush();
+            append(bytes);
+            return;
+        }
+        // Larger than the buffer: send both with one system call.
+        iovec iov[2] = {{buf_.data(), used_},
+                        {const_cast<char *>(bytes.data()), bytes.size()}};
+        write_all(iov, 2);
+        used_ = 0;
+    }
+
+    void append_int(long long v) {
+        if (buf_.size() - used_ < 24) flush();
+        auto res = std::to_chars(buf_.data() + used_, buf_.data() + buf_.size(), v);
+        used_ = static_cast<std::size_t>(res.ptr - buf_.data());
+    }
+
+    void append_varint(unsigned long long v) {
+        if (buf_.size() - used_ < 10) flush();
+        while (v >= 0x80) {
+            buf_[used_++] = static_cast<char>((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        buf_[used_++] = static_cast<char>(v);
+    }
+
+    // Flushes and closes the file. Returns false if anything failed to write.
+    bool close() {
+        if (fd_ < 0) return !failed_;
+        flush();
+        if (::close(fd_) != 0) failed_ = true;
+        fd_ = -1;
+        return !failed_;
+    }
+
+private:
+    void flush() {
+        if (used_ == 0) return;
+        iovec iov = {buf_.data(), used_};
+        write_all(&iov, 1);
+        used_ = 0;
+    }
+
+    // writev until everything is out; short writes resume mid-vector.
+    void write_all(iovec *iov, int count) {
+        while (count > 0 && !failed_) {
+            ssize_t n = ::writev(fd_, iov, count);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                failed_ = true;
+                std::perror("Error: write failed");
+                return;
+            }
+            std::size_t left = static_cast<std::size_t>(n);
+            while (count > 0 && left >= iov->iov_len) {
+                left -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+                iov->iov_len -= left;
+            }
+        }
+    }
+
+    ResultFormat format_;
+    std::vector<char> buf_;
+    std::size_t used_ = 0;
+    int fd_ = -1;
+    bool failed_ = false;
+};
+
+// Reads records written by ResultWriter in the Binary format.
+class BinaryResultReader {
+public:
+    explicit BinaryResultReader(const std::string &path)
+        : fp_(std::fopen(path.c_str(), "rb")) {
+        if (fp_) std::setvbuf(fp_, nullptr, _IOFBF, ResultWriter::kBufferSize);
+    }
+    ~BinaryResultReader() {
+        if (fp_) std::fclose(fp_);
+    }
+    BinaryResultReader(const BinaryResultReader &) = delete;
+    BinaryResultReader &operator=(const BinaryResultReader &) = delete;
+
+    bool ok() const { return fp_ != nullptr; }
+
+    bool next(std::string &key, long long &value) {
+        unsigned long long len, count;
+        if (!read_varint(len)) return false;
+        key.resize(len);
+        if (len > 0 && std::fread(&key[0], 1, len, fp_) != len) return false;
+        if (!read_varint(count)) return false;
+        value = static_cast<long long>(count);
+        return true;
+    }
+
+private:
+    bool read_varint(unsigned long long &v) {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int c = std::getc(fp_);
+            if (c == EOF) return false;
+            v |= static_cast<unsigned long long>(c & 0x7F) << shift;
+            if (!(c & 0x80)) return true;
+        }
+        return false;
+    }
+
+    FILE *fp_;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef STRING_ARENA_H
+#define STRING_ARENA_H
+
+// Key storage shared by the MapReduce jobs (wordcount, longest_path).
+//
+// StringArena is a bump allocator for immutable byte strings: bytes are
+// appended to large blocks that never move, so a string_view into the arena
+// stays valid until clear(). InternTable sits on top of it and maps every
+// distinct key to a dense 32-bit id, so map and reduce stages can pass ids
+// around instead of owning std::strings.
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// FNV-1a, good enough for short keys and cheap to compute.
+constexpr std::uint64_t fnv1a(std::string_view key) {
+    std::uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+class StringArena {
+public:
+    explicit StringArena(std::size_t block_size = 64 * 1024)
+        : block_size_(block_size) {}
+
+    StringArena(StringArena &&) = default;
+    StringArena &operator=(StringArena &&) = default;
+    StringArena(const StringArena &) = delete;
+    StringArena &operator=(const StringArena &) = delete;
+
+    std::string_view store(std::string_view s) {
+        if (s.size() > block_size_ / 4) {
+            // Large strings get a block of their own so the current block's
+            // remaining space is not wasted.
+            blocks_.emplace_back(new char[s.size()]);
+            reserved_ += s.size();
+            std::memcpy(blocks_.back().get(), s.data(), s.size());
+            return std::string_view(blocks_.back().get(), s.size());
+        }
+        if (s.size() > left_) {
+            blocks_.emplace_back(new char[block_size_]);
+            reserved_ += block_size_;
+            next_ = blocks_.back().get();
+            left_ = block_size_;
+        }
+        if (!s.empty()) std::memcpy(next_, s.data(), s.size());
+        std::string_view out(next_, s.size());
+        next_ += s.size();
+        left_ -= s.size();
+        return out;
+    }
+
+    std::size_t bytes_reserved() const { return reserved_; }
+
+    void clear() {
+        blocks_.clear();
+        next_ = nullptr;
+        left_ = 0;
+        reserved_ = 0;
+    }
+
+private:
+    std::size_t block_size_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char *next_ = nullptr;
+    std::size_t left_ = 0;
+    std::size_t reserved_ = 0;
+};
+
+// Open-addressing index from key bytes to dense ids 0, 1, 2, ... in first-seen
+// order. The caller supplies the hash so each job keeps its own hash function
+// (and its partitioning stays stable).
+class InternTable {
+public:
+    static constexpr std::uint32_t kNone = 0xFFFFFFFFu;
+
+    explicit InternTable(std::size_t capacity = 1024) {
+        std::size_t cap = 16;
+        while (cap < capacity) cap <<= 1;
+        index_.assign(cap, Slot{kNone, 0});
+    }
+
+    // Returns the id of `key`, adding it if new. New ids equal size() - 1
+    // right after the call.
+    std::uint32_t intern(std::string_view key, std::uint64_t hash) {
+        if ((keys_.size() + 1) * 10 > index_.size() * 7) grow();
+        std::size_t mask = index_.size() - 1;
+        std::uint32_t tag = static_cast<std::uint32_t>(hash >> 32);
+        for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot &s = index_[i];
+            if (s.id == kNone) {
+                s.id = static_cast<std::uint32_t>(keys_.size());
+                s.tag = tag;
+                std::string_view stored = arena_.store(key);
+                keys_.push_back({stored.data(), static_cast<std::uint32_t>(stored.size())});
+                hashes_.push_back(hash);
+                return s.id;
+            }
+            if (s.tag == tag && this->key(s.id) == key) {
+                return s.id;
+            }
+        }
+    }
+
+    std::uint32_t find(std::string_view key, std::uint64_t hash) const {
+        std::size_t mask = index_.size() - 1;
+        std::uint32_t tag = static_cast<std::uint32_t>(hash >> 32);
+        for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot &s = index_[i];
+            if (s.id == kNone) return kNone;
+            if (s.tag == tag && this->key(s.id) == key) {
+                return s.id;
+            }
+        }
+    }
+
+    std::string_view key(std::uint32_t id) const {
+        return std::string_view(keys_[id].data, keys_[id].length);
+    }
+    std::uint32_t length(std::uint32_t id) const { return keys_[id].length; }
+    std::uint64_t hash(std::uint32_t id) const { return hashes_[id]; }
+    std::size_t size() const { return keys_.size(); }
+
+    std::size_t memory_bytes() const {
+        return index_.capacity() * sizeof(Slot) +
+               keys_.capacity() * sizeof(KeyRef) +
+               hashes_.capacity() * sizeof(std::uint64_t) +
+               arena_.bytes_reserved();
+    }
+
+    void clear() { *this = InternTable(); }
+
+private:
+    struct Slot {
+        std::uint32_t id;
+        std::uint32_t tag;  // high half of the hash, filters most mismatches
+    };
+    struct KeyRef {
+        const char *data;
+        std::uint32_t length;
+    };
+
+    void grow() {
+        std::vector<Slot> bigger(index_.size() * 2, Slot{kNone, 0});
+        std::size_t mask = bigger.size() - 1;
+        for (const Slot &s : index_) {
+            if (s.id == kNone) continue;
+            std::size_t i = hashes_[s.id] & mask;
+            while (bigger[i].id != kNone) i = (i + 1) & mask;
+            bigger[i] = s;
+        }
+        index_.swap(bigger);
+    }
+
+    StringArena arena_;
+    std::vector<Slot> index_;
+    std::vector<KeyRef> keys_;
+    std::vector<std::uint64_t> hashes_;
+};
+
+#endif